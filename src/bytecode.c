@@ -133,6 +133,14 @@ static void make_stderr( program_t *prg )
 		prg->stderr_val = colm_stream_open_fd( prg, "<stderr>", 2 );
 }
 
+void colm_commit_print_stdout( program_t *prg, tree_t **sp, tree_t *tree, void *arg )
+{
+	make_stdout( prg );
+
+	struct stream_impl *si = stream_to_impl( prg->stdout_val );
+	si->funcs->print_tree( prg, sp, si, tree, false );
+}
+
 static void flush_streams( program_t *prg )
 {
 	if ( prg->stdout_val != 0 ) {
@@ -278,12 +286,49 @@ static void stream_undo_append_stream( program_t *prg, tree_t **sp, struct input
 	is->funcs->undo_append_stream( prg, is );
 }
 
+/* Streams share the pull instructions with inputs, but their impl has the
+ * stream functions. */
+static int impl_is_stream( struct input_impl *impl )
+{
+	return ((struct stream_impl_data*)impl)->type == 'D';
+}
+
+/* Up to length bytes from a stream, fewer at the end of it. */
+static head_t *stream_pull_data( program_t *prg, struct stream_impl *si, long length )
+{
+	head_t *head = init_str_space( length );
+	char *dest = (char*)head->data;
+	long got = 0;
+
+	while ( got < length ) {
+		int skip = got, copied = 0;
+		char *src = 0;
+		int type = si->funcs->get_parse_block( prg, si, &skip, &src, &copied );
+		if ( type != INPUT_DATA )
+			break;
+
+		long take = copied < length - got ? copied : length - got;
+		memcpy( dest + got, src, take );
+		got += take;
+	}
+
+	location_t *loc = location_allocate( prg );
+	si->funcs->consume_data( prg, si, got, loc );
+	head->length = got;
+	head->location = loc;
+	return head;
+}
+
 static tree_t *stream_pull_bc( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 		input_t *input, tree_t *length )
 {
 	long len = ((long)length);
 	struct input_impl *impl = input_to_impl( input );
-	head_t *tokdata = colm_stream_pull( prg, sp, pda_run, impl, len );
+	head_t *tokdata;
+	if ( impl_is_stream( impl ) )
+		tokdata = stream_pull_data( prg, (struct stream_impl*)impl, len );
+	else
+		tokdata = colm_stream_pull( prg, sp, pda_run, impl, len );
 	return construct_string( prg, tokdata );
 }
 
@@ -291,7 +336,13 @@ static tree_t *stream_pull_bc( program_t *prg, tree_t **sp, struct pda_run *pda_
 static void undo_stream_pull( struct colm_program *prg, struct input_impl *is, const char *data, long length )
 {
 	//debug( REALM_PARSE, "undoing stream pull\n" );
-	is->funcs->undo_consume_data( prg, is, data, length );
+	if ( impl_is_stream( is ) ) {
+		struct stream_impl *si = (struct stream_impl*)is;
+		si->funcs->undo_consume_data( prg, si, data, length );
+	}
+	else {
+		is->funcs->undo_consume_data( prg, is, data, length );
+	}
 }
 
 static void undo_pull( program_t *prg, input_t *input, tree_t *str )
@@ -626,6 +677,122 @@ tree_t *colm_run_func( struct colm_program *prg, int frame_id,
 	return prg->return_val;
 };
 
+/*
+ * Parsers driven by the host. Each call to run resumes the parse with the
+ * data sent so far. The VM only runs for the parse, the actions it calls
+ * and their returns, so nothing is left on the stack between calls.
+ */
+
+static code_t host_parse_code[] = { IN_PARSE_FRAG_W, IN_FN, FN_STOP };
+
+struct colm_parser *colm_parser_open( struct colm_program *prg, const char *type_name )
+{
+	long g;
+	for ( g = 0; g < prg->rtd->num_generics; g++ ) {
+		struct generic_info *gi = &prg->rtd->generic_info[g];
+		if ( gi->type == GEN_PARSER && strcmp( type_name,
+				prg->rtd->lel_info[prg->rtd->parser_lel_ids[gi->parser_id]].name ) == 0 )
+		{
+			return (parser_t*)colm_construct_generic( prg, g, 0 );
+		}
+	}
+	return 0;
+}
+
+void colm_parser_send( struct colm_program *prg, struct colm_parser *parser,
+		const char *data, long length )
+{
+	if ( length <= 0 )
+		return;
+
+	struct stream_impl *span = colm_impl_new_span(
+			colm_filename_add( prg, "<input>" ), data, length, parser->last_span );
+	colm_input_append_impl( prg, parser->input, span );
+	parser->last_span = span;
+}
+
+int colm_parser_run( struct colm_program *prg, struct colm_parser *parser )
+{
+	struct pda_run *pda_run = parser->pda_run;
+
+	/* Once the end of the input is parsed there is nothing left to do. */
+	if ( !pda_run->parse_error && !pda_run->eof_term_recvd && !prg->induce_exit ) {
+		execution_t execution;
+		memset( &execution, 0, sizeof(execution) );
+		execution.frame_id = -1;
+		execution.parser = parser;
+		execution.pcr = PCR_START;
+		execution.steps = pda_run->steps;
+
+		tree_t **sp = prg->stack_root;
+		vm_push_parser( parser );
+		sp = colm_execute_code( prg, &execution, sp, host_parse_code );
+
+		/* An exit from an action leaves the stack as it was. */
+		if ( prg->induce_exit )
+			return COLM_PARSE_ERROR;
+
+		vm_pop_parser();
+	}
+
+	if ( pda_run->parse_error || prg->induce_exit )
+		return COLM_PARSE_ERROR;
+
+	return pda_run->eof_term_recvd ? COLM_PARSE_DONE : COLM_PARSE_MORE;
+}
+
+struct colm_tree *colm_parser_finish( struct colm_program *prg, struct colm_parser *parser )
+{
+	struct input_impl *si = input_to_impl( parser->input );
+	si->funcs->set_eof_mark( prg, si, true );
+
+	if ( colm_parser_run( prg, parser ) != COLM_PARSE_DONE )
+		return 0;
+
+	struct pda_run *pda_run = parser->pda_run;
+	if ( prg->share_tokens && !pda_run->tokens_shared ) {
+		pda_run->tokens_shared = true;
+		colm_share_tokens( prg, prg->stack_root, get_parser_mem( parser, 0 ) );
+	}
+
+	return get_parser_mem( parser, 0 );
+}
+
+const char *colm_parser_error( struct colm_program *prg,
+		struct colm_parser *parser, int *length )
+{
+	tree_t *error = parser->pda_run->parse_error_text;
+	if ( error == 0 || error->tokdata == 0 )
+		return 0;
+
+	if ( length != 0 )
+		*length = error->tokdata->length;
+	return error->tokdata->data;
+}
+
+void colm_parser_close( struct colm_program *prg, struct colm_parser *parser )
+{
+	input_t *input = parser->input;
+
+	/* Tokens cut by the end of a span are copied into consume buffers. They
+	 * go with the parser, the same as the sent data, rather than to the
+	 * program, where a long running host would pile them up. */
+	struct run_buf *consume_buf = parser->pda_run->consume_buf;
+	parser->pda_run->consume_buf = 0;
+
+	colm_struct_remove( prg, (struct colm_struct*)parser );
+	colm_struct_delete( prg, prg->stack_root, (struct colm_struct*)parser );
+
+	colm_struct_remove( prg, (struct colm_struct*)input );
+	colm_struct_delete( prg, prg->stack_root, (struct colm_struct*)input );
+
+	while ( consume_buf != 0 ) {
+		struct run_buf *next = consume_buf->next;
+		free_run_buf( prg, consume_buf );
+		consume_buf = next;
+	}
+}
+
 int colm_make_reverse_code( struct pda_run *pda_run )
 {
 	struct rt_code_vect *reverse_code = &pda_run->reverse_code;
@@ -1757,8 +1924,8 @@ again:
 
 			tree_t *o2 = vm_pop_tree();
 			tree_t *o1 = vm_pop_tree();
-			long r = colm_cmp_tree( prg, o1, o2 );
-			value_t val = r == 0 ? TRUE_VAL : FALSE_VAL;
+			int eql = colm_tree_eql( prg, o1, o2 );
+			value_t val = eql ? TRUE_VAL : FALSE_VAL;
 			vm_push_value( val );
 			colm_tree_downref( prg, sp, o1 );
 			colm_tree_downref( prg, sp, o2 );
@@ -1778,8 +1945,8 @@ again:
 
 			tree_t *o2 = vm_pop_tree();
 			tree_t *o1 = vm_pop_tree();
-			long r = colm_cmp_tree( prg, o1, o2 );
-			value_t val = r != 0 ? TRUE_VAL : FALSE_VAL;
+			int eql = colm_tree_eql( prg, o1, o2 );
+			value_t val = !eql ? TRUE_VAL : FALSE_VAL;
 			vm_push_value( val );
 			colm_tree_downref( prg, sp, o1 );
 			colm_tree_downref( prg, sp, o2 );
@@ -2274,8 +2441,6 @@ again:
 			tree_t *tree = vm_pop_tree();
 
 			/* Run the match, push the result. */
-			int root_node = prg->rtd->pat_repl_info[pattern_id].offset;
-
 			/* Bindings are indexed starting at 1. Zero bindId to represent no
 			 * binding. We make a space for it here rather than do math at
 			 * access them. */
@@ -2286,7 +2451,7 @@ again:
 			kid_t kid;
 			kid.tree = tree;
 			kid.next = 0;
-			int matched = match_pattern( bindings, prg, root_node, &kid, false );
+			int matched = prg->rtd->match_pattern( prg, pattern_id, bindings, &kid );
 
 			if ( !matched )
 				memset( bindings, 0, sizeof(tree_t*)*(1+num_bindings) );
@@ -2434,6 +2599,9 @@ again:
 
 			word_t len = stream_append_stream( prg, sp, parser->input, to_send );
 
+			if ( to_send == prg->stdin_val && prg->commit_print != 0 )
+				parser->pda_run->stream_commits = true;
+
 			vm_push_parser( parser );
 
 			if ( exec->WV ) {
@@ -3037,6 +3205,7 @@ again:
 			head_t *head = string_copy( prg, ((str_t*)val)->value );
 			string_free( prg, tree->tokdata );
 			tree->tokdata = head;
+			tree->hash = 0;
 
 			colm_tree_downref( prg, sp, tree );
 			colm_tree_downref( prg, sp, val );
@@ -3051,6 +3220,7 @@ again:
 			head_t *oldval = tree->tokdata;
 			head_t *head = string_copy( prg, ((str_t*)val)->value );
 			tree->tokdata = head;
+			tree->hash = 0;
 
 			/* Set up reverse code. Needs no args. */
 			rcode_code( exec, IN_SET_TOKEN_DATA_BKT );
@@ -3071,6 +3241,7 @@ again:
 			head_t *head = (head_t*)oldval;
 			string_free( prg, tree->tokdata );
 			tree->tokdata = head;
+			tree->hash = 0;
 			colm_tree_downref( prg, sp, tree );
 			break;
 		}
@@ -3146,6 +3317,14 @@ again:
 			vm_push_value( res );
 			break;
 		}
+		case IN_VECTOR_LENGTH: {
+			debug( prg, REALM_BYTECODE, "IN_VECTOR_LENGTH\n" );
+
+			vector_t *vector = vm_pop_vector();
+			value_t res = vector->len;
+			vm_push_value( res );
+			break;
+		}
 		case IN_GET_LIST_EL_MEM_R: {
 			short gen_id, field;
 			read_half( gen_id );
@@ -3294,6 +3473,15 @@ again:
 
 			parser_t *parser = vm_pop_parser();
 
+			/* A finished parse can give up its duplicate tokens. */
+			if ( field == 0 && prg->share_tokens &&
+					parser->pda_run->eof_term_recvd &&
+					!parser->pda_run->tokens_shared )
+			{
+				parser->pda_run->tokens_shared = true;
+				colm_share_tokens( prg, sp, get_parser_mem( parser, field ) );
+			}
+
 			tree_t *val = get_parser_mem( parser, field );
 
 			colm_tree_upref( prg, val );
@@ -4326,6 +4514,357 @@ again:
 					colm_tree_downref( prg, sp, key );
 				break;
 			}
+			case FN_VMAP_APPEND_WC:
+			case FN_VMAP_APPEND_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VMAP_APPEND %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				struct_t *value = vm_pop_struct();
+				struct_t *key = vm_pop_struct();
+
+				map_el_t *appended = colm_vmap_append( prg, sp, map, key, value );
+
+				vm_push_value( appended != 0 ? 1 : 0 );
+
+				if ( c == FN_VMAP_APPEND_WV ) {
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_VMAP_APPEND_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)appended );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_VMAP_APPEND_BKT: {
+				short gen_id;
+				word_t wmap_el;
+
+				read_half( gen_id );
+				read_word( wmap_el );
+
+				map_el_t *map_el = (map_el_t*)wmap_el;
+
+				debug( prg, REALM_BYTECODE, "FN_VMAP_APPEND_BKT %d\n",
+						map_el != 0 );
+
+				map_t *map = vm_pop_map();
+
+				if ( map_el != 0 )
+					colm_map_detach( prg, map, map_el );
+				break;
+			}
+			case FN_MAP_UNION_WC:
+			case FN_MAP_UNION_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_UNION %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				map_t *other = vm_pop_map();
+
+				map_el_t **added = 0;
+				long n = colm_map_union( prg, map, other,
+						c == FN_MAP_UNION_WV ? &added : 0 );
+
+				vm_push_value( n );
+
+				if ( c == FN_MAP_UNION_WV ) {
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_MAP_UNION_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)n );
+					rcode_word( exec, (word_t)added );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_MAP_UNION_BKT: {
+				short gen_id;
+				word_t n, wadded;
+
+				read_half( gen_id );
+				read_word( n );
+				read_word( wadded );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_UNION_BKT %ld\n", (long)n );
+
+				map_el_t **added = (map_el_t**)wadded;
+				map_t *map = vm_pop_map();
+
+				if ( n > 0 ) {
+					colm_map_unmerge( map, added, n );
+					free( added );
+				}
+				break;
+			}
+			case FN_MAP_INTERSECT_WC:
+			case FN_MAP_INTERSECT_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_INTERSECT %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				map_t *other = vm_pop_map();
+
+				map_el_t **removed = 0;
+				long n = colm_map_intersect( prg, map, other,
+						c == FN_MAP_INTERSECT_WV ? &removed : 0 );
+
+				vm_push_value( n );
+
+				if ( c == FN_MAP_INTERSECT_WV ) {
+					/* The elements stay on the heap, reverting puts them back. */
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_MAP_INTERSECT_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)n );
+					rcode_word( exec, (word_t)removed );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_MAP_INTERSECT_BKT: {
+				short gen_id;
+				word_t n, wremoved;
+
+				read_half( gen_id );
+				read_word( n );
+				read_word( wremoved );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_INTERSECT_BKT %ld\n", (long)n );
+
+				map_el_t **removed = (map_el_t**)wremoved;
+				map_t *map = vm_pop_map();
+
+				if ( n > 0 ) {
+					colm_map_remerge( prg, map, removed, n );
+					free( removed );
+				}
+				break;
+			}
+			case FN_MAP_LOWER_BOUND: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_LOWER_BOUND %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				tree_t *key = vm_pop_tree();
+
+				map_el_t *map_el = colm_map_lower_bound( prg, map, key );
+
+				vm_push_struct( map_el != 0 ?
+						colm_generic_el_container( prg, map_el, gen_id ) : 0 );
+
+				if ( map->generic_info->key_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, key );
+				break;
+			}
+			case FN_HMAP_FIND: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_FIND %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				tree_t *key = vm_pop_tree();
+
+				tree_t *result = colm_hmap_find( prg, map, key );
+
+				vm_push_tree( result );
+
+				if ( map->generic_info->key_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, key );
+				break;
+			}
+			case FN_HMAP_INSERT_WC: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_INSERT_WC %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				struct_t *value = vm_pop_struct();
+				struct_t *key = vm_pop_struct();
+
+				map_el_t *inserted = colm_hmap_insert( prg, sp, map, key, value );
+
+				vm_push_value( inserted != 0 ? 1 : 0 );
+				break;
+			}
+			case FN_HMAP_INSERT_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_INSERT_WV %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				struct_t *value = vm_pop_struct();
+				struct_t *key = vm_pop_struct();
+
+				map_el_t *inserted = colm_hmap_insert( prg, sp, map, key, value );
+
+				vm_push_value( inserted != 0 ? 1 : 0 );
+
+				rcode_code( exec, IN_FN );
+				rcode_code( exec, FN_HMAP_INSERT_BKT );
+				rcode_half( exec, gen_id );
+				rcode_word( exec, (word_t)inserted );
+				rcode_unit_term( exec );
+				break;
+			}
+			case FN_HMAP_INSERT_BKT:
+			case FN_HMAP_INSERT_EL_BKT: {
+				short gen_id;
+				word_t wmap_el;
+
+				read_half( gen_id );
+				read_word( wmap_el );
+
+				map_el_t *map_el = (map_el_t*)wmap_el;
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_INSERT_BKT %d\n",
+						map_el != 0 );
+
+				map_t *map = vm_pop_map();
+
+				if ( map_el != 0 )
+					colm_hmap_detach( prg, map, map_el );
+				break;
+			}
+			case FN_HMAP_REMOVE_WC: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_REMOVE_WC %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				tree_t *key = vm_pop_tree();
+
+				map_el_t *map_el = colm_hmap_remove( prg, map, key );
+
+				vm_push_struct( map_el != 0 ?
+						colm_generic_el_container( prg, map_el, gen_id ) : 0 );
+
+				if ( map->generic_info->key_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, key );
+				break;
+			}
+			case FN_HMAP_REMOVE_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_REMOVE_WV %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				tree_t *key = vm_pop_tree();
+
+				map_el_t *map_el = colm_hmap_remove( prg, map, key );
+
+				vm_push_struct( map_el != 0 ?
+						colm_generic_el_container( prg, map_el, gen_id ) : 0 );
+
+				if ( map->generic_info->key_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, key );
+
+				/* The element stays on the heap, reverting puts it back. */
+				rcode_code( exec, IN_FN );
+				rcode_code( exec, FN_HMAP_REMOVE_BKT );
+				rcode_half( exec, gen_id );
+				rcode_word( exec, (word_t)map_el );
+				rcode_unit_term( exec );
+				break;
+			}
+			case FN_HMAP_REMOVE_BKT:
+			case FN_HMAP_DETACH_EL_BKT: {
+				short gen_id;
+				word_t wmap_el;
+
+				read_half( gen_id );
+				read_word( wmap_el );
+
+				map_el_t *map_el = (map_el_t*)wmap_el;
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_REMOVE_BKT %d\n",
+						map_el != 0 );
+
+				map_t *map = vm_pop_map();
+
+				if ( map_el != 0 )
+					colm_hmap_insert_el( prg, map, map_el );
+				break;
+			}
+			case FN_HMAP_FIND_EL: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_FIND_EL %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				tree_t *key = vm_pop_tree();
+
+				map_el_t *map_el = colm_hmap_find_el( prg, map, key );
+
+				vm_push_struct( map_el != 0 ?
+						colm_generic_el_container( prg, map_el, gen_id ) : 0 );
+
+				if ( map->generic_info->key_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, key );
+				break;
+			}
+			case FN_HMAP_INSERT_EL_WC:
+			case FN_HMAP_INSERT_EL_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_INSERT_EL %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				struct_t *s = vm_pop_struct();
+
+				map_el_t *map_el = colm_struct_to_map_el( prg, s, gen_id );
+				map_el_t *inserted = colm_hmap_insert_el( prg, map, map_el );
+
+				vm_push_value( inserted != 0 ? 1 : 0 );
+
+				if ( c == FN_HMAP_INSERT_EL_WV ) {
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_HMAP_INSERT_EL_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)inserted );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_HMAP_DETACH_EL_WC:
+			case FN_HMAP_DETACH_EL_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_DETACH_EL %hd\n", gen_id );
+
+				map_t *map = vm_pop_map();
+				struct_t *s = vm_pop_struct();
+
+				map_el_t *map_el = colm_struct_to_map_el( prg, s, gen_id );
+				colm_hmap_detach( prg, map, map_el );
+
+				vm_push_struct( s );
+
+				if ( c == FN_HMAP_DETACH_EL_WV ) {
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_HMAP_DETACH_EL_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)map_el );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
 			case FN_VLIST_PUSH_TAIL_WC: {
 				short gen_id;
 				read_half( gen_id );
@@ -4494,6 +5033,197 @@ again:
 				colm_vlist_append( prg, list, (value_t)val );
 				break;
 			}
+			case FN_VECTOR_PUSH_WC:
+			case FN_VECTOR_PUSH_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_PUSH %hd\n", gen_id );
+
+				vector_t *vector = vm_pop_vector();
+				value_t value = vm_pop_value();
+
+				colm_vector_push( prg, vector, value );
+
+				vm_push_value( 1 );
+
+				if ( c == FN_VECTOR_PUSH_WV ) {
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_VECTOR_PUSH_BKT );
+					rcode_half( exec, gen_id );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_VECTOR_PUSH_BKT: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_PUSH_BKT\n" );
+
+				vector_t *vector = vm_pop_vector();
+				value_t value = colm_vector_pop( prg, vector );
+
+				if ( vector->generic_info->value_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, (tree_t*)value );
+				break;
+			}
+			case FN_VECTOR_POP_WC:
+			case FN_VECTOR_POP_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_POP %hd\n", gen_id );
+
+				vector_t *vector = vm_pop_vector();
+				uchar popped = vector->len > 0;
+
+				value_t result = colm_vector_pop( prg, vector );
+				vm_push_value( result );
+
+				if ( c == FN_VECTOR_POP_WV ) {
+					/* The reverse code keeps a reference for putting it back. */
+					if ( vector->generic_info->value_type == TYPE_TREE )
+						colm_tree_upref( prg, (tree_t*)result );
+
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_VECTOR_POP_BKT );
+					rcode_half( exec, gen_id );
+					rcode_code( exec, popped );
+					rcode_word( exec, (word_t)result );
+					rcode_unit_term( exec );
+				}
+				break;
+			}
+			case FN_VECTOR_POP_BKT: {
+				short gen_id;
+				uchar popped;
+				word_t value;
+
+				read_half( gen_id );
+				read_byte( popped );
+				read_word( value );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_POP_BKT\n" );
+
+				vector_t *vector = vm_pop_vector();
+				if ( popped )
+					colm_vector_push( prg, vector, value );
+				break;
+			}
+			case FN_VECTOR_GET: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_GET %hd\n", gen_id );
+
+				vector_t *vector = vm_pop_vector();
+				long pos = (long)vm_pop_value();
+
+				value_t result = colm_vector_get( prg, vector, pos );
+				vm_push_value( result );
+				break;
+			}
+			case FN_VECTOR_SET_WC:
+			case FN_VECTOR_SET_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_SET %hd\n", gen_id );
+
+				vector_t *vector = vm_pop_vector();
+				value_t value = vm_pop_value();
+				long pos = (long)vm_pop_value();
+				int is_tree = vector->generic_info->value_type == TYPE_TREE;
+
+				if ( pos < 0 || pos >= vector->len ) {
+					if ( is_tree )
+						colm_tree_downref( prg, sp, (tree_t*)value );
+					vm_push_value( 0 );
+					break;
+				}
+
+				value_t old = vector->data[pos];
+				vector->data[pos] = value;
+				vm_push_value( 1 );
+
+				if ( c == FN_VECTOR_SET_WV ) {
+					/* The old value's reference moves to the reverse code. */
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_VECTOR_SET_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)pos );
+					rcode_word( exec, (word_t)old );
+					rcode_unit_term( exec );
+				}
+				else if ( is_tree ) {
+					colm_tree_downref( prg, sp, (tree_t*)old );
+				}
+				break;
+			}
+			case FN_VECTOR_SET_BKT: {
+				short gen_id;
+				word_t pos, old;
+
+				read_half( gen_id );
+				read_word( pos );
+				read_word( old );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_SET_BKT\n" );
+
+				vector_t *vector = vm_pop_vector();
+				value_t value = vector->data[pos];
+				vector->data[pos] = old;
+
+				if ( vector->generic_info->value_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, (tree_t*)value );
+				break;
+			}
+			case FN_VECTOR_SORT_WC:
+			case FN_VECTOR_SORT_WV: {
+				short gen_id;
+				read_half( gen_id );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_SORT %hd\n", gen_id );
+
+				vector_t *vector = vm_pop_vector();
+
+				if ( c == FN_VECTOR_SORT_WV ) {
+					/* Reverting restores the order from a copy. */
+					value_t *saved = 0;
+					if ( vector->len > 0 ) {
+						saved = (value_t*) malloc( sizeof(value_t) * vector->len );
+						memcpy( saved, vector->data, sizeof(value_t) * vector->len );
+					}
+
+					rcode_code( exec, IN_FN );
+					rcode_code( exec, FN_VECTOR_SORT_BKT );
+					rcode_half( exec, gen_id );
+					rcode_word( exec, (word_t)saved );
+					rcode_unit_term( exec );
+				}
+
+				colm_vector_sort( prg, vector );
+				vm_push_value( 1 );
+				break;
+			}
+			case FN_VECTOR_SORT_BKT: {
+				short gen_id;
+				word_t wsaved;
+
+				read_half( gen_id );
+				read_word( wsaved );
+
+				debug( prg, REALM_BYTECODE, "FN_VECTOR_SORT_BKT\n" );
+
+				value_t *saved = (value_t*)wsaved;
+				vector_t *vector = vm_pop_vector();
+				if ( saved != 0 ) {
+					memcpy( vector->data, saved, sizeof(value_t) * vector->len );
+					free( saved );
+				}
+				break;
+			}
 
 			case FN_EXIT_HARD: {
 				debug( prg, REALM_BYTECODE, "FN_EXIT\n" );
@@ -4830,6 +5560,36 @@ again:
 				colm_tree_downref( prg, sp, val );
 				break;
 			}
+			case FN_VMAP_APPEND_BKT: {
+				consume_half(); //( genId );
+				consume_word(); //( wmapEl );
+
+				debug( prg, REALM_BYTECODE, "FN_VMAP_APPEND_BKT\n" );
+				break;
+			}
+			case FN_MAP_UNION_BKT:
+			case FN_MAP_INTERSECT_BKT: {
+				word_t wels;
+
+				consume_half(); //( genId );
+				consume_word(); //( n );
+				read_word( wels );
+
+				debug( prg, REALM_BYTECODE, "FN_MAP_MERGE_BKT\n" );
+
+				free( (map_el_t**)wels );
+				break;
+			}
+			case FN_HMAP_INSERT_BKT:
+			case FN_HMAP_INSERT_EL_BKT:
+			case FN_HMAP_REMOVE_BKT:
+			case FN_HMAP_DETACH_EL_BKT: {
+				consume_half(); //( genId );
+				consume_word(); //( wmapEl );
+
+				debug( prg, REALM_BYTECODE, "FN_HMAP_BKT\n" );
+				break;
+			}
 
 			case FN_VLIST_PUSH_TAIL_BKT: {
 				break;
@@ -4855,6 +5615,45 @@ again:
 				break;
 			}
 
+			case FN_VECTOR_PUSH_BKT: {
+				consume_half(); //( genId );
+				break;
+			}
+			case FN_VECTOR_POP_BKT: {
+				short gen_id;
+				uchar popped;
+				word_t value;
+
+				read_half( gen_id );
+				read_byte( popped );
+				read_word( value );
+
+				if ( popped && prg->rtd->generic_info[gen_id].value_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, (tree_t*)value );
+				break;
+			}
+			case FN_VECTOR_SET_BKT: {
+				short gen_id;
+				word_t old;
+
+				read_half( gen_id );
+				consume_word(); //( pos );
+				read_word( old );
+
+				if ( prg->rtd->generic_info[gen_id].value_type == TYPE_TREE )
+					colm_tree_downref( prg, sp, (tree_t*)old );
+				break;
+			}
+			case FN_VECTOR_SORT_BKT: {
+				word_t saved;
+
+				consume_half(); //( genId );
+				read_word( saved );
+
+				free( (value_t*)saved );
+				break;
+			}
+
 			default: {
 				fatal( "UNKNOWN FUNCTION 0x%02x: -- reverse code downref\n", *(instr-1));
 				assert(false);
@@ -202,6 +202,8 @@ typedef unsigned char uchar;
 
 #define IN_LIST_LENGTH           0x72
 
+#define IN_VECTOR_LENGTH         0x82
+
 #define IN_GET_LIST_MEM_R        0x79
 #define IN_GET_LIST_MEM_WC       0x7a
 #define IN_GET_LIST_MEM_WV       0x7b
@@ -404,6 +406,31 @@ typedef unsigned char uchar;
 #define FN_VMAP_INSERT_BKT       0x3d
 #define FN_VMAP_REMOVE_WC        0x27
 #define FN_VMAP_REMOVE_WV        0x28
+#define FN_VMAP_APPEND_WV        0x60
+#define FN_VMAP_APPEND_WC        0x61
+#define FN_VMAP_APPEND_BKT       0x62
+#define FN_MAP_UNION_WV          0x63
+#define FN_MAP_UNION_WC          0x64
+#define FN_MAP_UNION_BKT         0x65
+#define FN_MAP_INTERSECT_WV      0x66
+#define FN_MAP_INTERSECT_WC      0x67
+#define FN_MAP_INTERSECT_BKT     0x68
+#define FN_MAP_LOWER_BOUND       0x69
+
+#define FN_HMAP_FIND             0x40
+#define FN_HMAP_INSERT_WV        0x41
+#define FN_HMAP_INSERT_WC        0x42
+#define FN_HMAP_INSERT_BKT       0x43
+#define FN_HMAP_REMOVE_WV        0x44
+#define FN_HMAP_REMOVE_WC        0x45
+#define FN_HMAP_REMOVE_BKT       0x46
+#define FN_HMAP_FIND_EL          0x47
+#define FN_HMAP_INSERT_EL_WV     0x48
+#define FN_HMAP_INSERT_EL_WC     0x49
+#define FN_HMAP_INSERT_EL_BKT    0x4a
+#define FN_HMAP_DETACH_EL_WV     0x4b
+#define FN_HMAP_DETACH_EL_WC     0x4c
+#define FN_HMAP_DETACH_EL_BKT    0x4d
 
 #define FN_VLIST_PUSH_TAIL_WV    0x2a
 #define FN_VLIST_PUSH_TAIL_WC    0x2b
@@ -417,6 +444,20 @@ typedef unsigned char uchar;
 #define FN_VLIST_POP_HEAD_WV     0x33
 #define FN_VLIST_POP_HEAD_WC     0x34
 #define FN_VLIST_POP_HEAD_BKT    0x35
+
+#define FN_VECTOR_PUSH_WV        0x50
+#define FN_VECTOR_PUSH_WC        0x51
+#define FN_VECTOR_PUSH_BKT       0x52
+#define FN_VECTOR_POP_WV         0x53
+#define FN_VECTOR_POP_WC         0x54
+#define FN_VECTOR_POP_BKT        0x55
+#define FN_VECTOR_GET            0x56
+#define FN_VECTOR_SET_WV         0x57
+#define FN_VECTOR_SET_WC         0x58
+#define FN_VECTOR_SET_BKT        0x59
+#define FN_VECTOR_SORT_WV        0x5a
+#define FN_VECTOR_SORT_WC        0x5b
+#define FN_VECTOR_SORT_BKT       0x5c
 #define FN_EXIT                  0x39
 #define FN_EXIT_HARD             0x3a
 #define FN_PREFIX                0x3b
@@ -426,7 +467,9 @@ typedef unsigned char uchar;
 enum GEN {
 	GEN_PARSER   = 0x14,
 	GEN_LIST     = 0x15,
-	GEN_MAP      = 0x16
+	GEN_MAP      = 0x16,
+	GEN_HASHMAP  = 0x17,
+	GEN_VECTOR   = 0x18
 };
 
 /* Known language element ids. */
@@ -458,12 +501,19 @@ enum LEL_ID {
 
 #define PF_RIGHT_IGNORE        0x0020
 
+/* Committed and handed to the commit print handler. The data tree left
+ * behind is hollow. */
+#define PF_STREAMED            0x0040
+
 #define PF_LEFT_IL_ATTACHED    0x0400
 #define PF_RIGHT_IL_ATTACHED   0x0800
 
 #define AF_LEFT_IGNORE   0x0100
 #define AF_RIGHT_IGNORE  0x0200
 
+/* The root of a tree index, which holds a reference to it. */
+#define AF_INDEXED       0x1000
+
 #define AF_SUPPRESS_LEFT  0x4000
 #define AF_SUPPRESS_RIGHT 0x8000
 
@@ -534,6 +584,7 @@ enum LEL_ID {
 #define vm_pop_parser() vm_pop_type(parser_t*)
 #define vm_pop_list()   vm_pop_type(list_t*)
 #define vm_pop_map()    vm_pop_type(map_t*)
+#define vm_pop_vector() vm_pop_type(vector_t*)
 #define vm_pop_value()  vm_pop_type(value_t)
 #define vm_pop_string() vm_pop_type(str_t*)
 #define vm_pop_kid()    vm_pop_type(kid_t*)
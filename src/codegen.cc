@@ -52,7 +52,27 @@ void FsmCodeGen::writeMain( long activeRealm )
 		"	int exit_status;\n"
 		"\n"
 		"	prg = colm_new_program( &" << objectName << " );\n"
-		"	colm_set_debug( prg, " << activeRealm << " );\n"
+		"	colm_set_debug( prg, " << activeRealm << " );\n";
+
+	if ( autoCommit > 0 )
+		out << "	colm_set_auto_commit( prg, " << autoCommit << " );\n";
+
+	if ( iterIndex )
+		out << "	colm_set_iter_index( prg, 1 );\n";
+
+	if ( treeHash )
+		out << "	colm_set_tree_hash( prg, 1 );\n";
+
+	if ( shareTokens )
+		out << "	colm_set_share_tokens( prg, 1 );\n";
+
+	if ( readAhead )
+		out << "	colm_set_read_ahead( prg, 1 );\n";
+
+	if ( commitPrint )
+		out << "	colm_set_commit_print( prg, &colm_commit_print_stdout, 0 );\n";
+
+	out <<
 		"	colm_run_program( prg, argc, argv );\n"
 		"	exit_status = colm_delete_program( prg );\n"
 		"	return exit_status;\n"
@@ -34,6 +34,7 @@ struct colm_program;
 struct colm_sections;
 struct colm_tree;
 struct colm_location;
+struct colm_parser;
 
 extern struct colm_sections colm_object;
 
@@ -44,6 +45,7 @@ struct colm_tree
 	/* First four will be overlaid in other structures. */
 	short id;
 	unsigned short flags;
+	unsigned int hash;
 	long refs;
 	struct colm_kid *child;
 
@@ -132,9 +134,64 @@ int colm_delete_program( struct colm_program *prg );
 void *colm_get_reduce_ctx( struct colm_program *prg );
 void colm_set_reduce_ctx( struct colm_program *prg, void *ctx );
 void colm_set_reduce_clean( struct colm_program *prg, unsigned char reduce_clean );
+void colm_set_auto_commit( struct colm_program *prg, long tokens );
+void colm_set_iter_index( struct colm_program *prg, unsigned char iter_index );
+void colm_set_tree_hash( struct colm_program *prg, unsigned char tree_hash );
+void colm_set_share_tokens( struct colm_program *prg, unsigned char share_tokens );
+void colm_set_read_ahead( struct colm_program *prg, unsigned char read_ahead );
+
+/* Called with each committed top-level tree of a parse of stdin, left to
+ * right. The tree is released when the handler returns and what remains in
+ * the parse result is a hollow tree of the same type. */
+typedef void (*colm_commit_print_t)( struct colm_program *prg,
+		struct colm_tree **sp, struct colm_tree *tree, void *arg );
+void colm_set_commit_print( struct colm_program *prg,
+		colm_commit_print_t commit_print, void *arg );
+
+/* Commit print handler that prints the tree to stdout. */
+void colm_commit_print_stdout( struct colm_program *prg,
+		struct colm_tree **sp, struct colm_tree *tree, void *arg );
 
 const char *colm_error( struct colm_program *prg, int *length );
 
+/*
+ * Incremental parsing driven by the host, for example from an event loop.
+ * Open a parser for a type the program parses, send it data as it arrives
+ * and run it after each send. Sent data is not copied, tokens point into it,
+ * so it must stay valid until the parser is closed and the trees are no
+ * longer used. Tokens that span two sends are copied, and the copies are
+ * freed when the parser is closed, so no token of the parse, including one
+ * kept by an action, can be used after that. Use these after
+ * colm_run_program has set up the globals.
+ */
+
+#define COLM_PARSE_MORE   1
+#define COLM_PARSE_DONE   2
+#define COLM_PARSE_ERROR  3
+
+/* Returns zero if the program has no parser for the type. */
+struct colm_parser *colm_parser_open( struct colm_program *prg, const char *type_name );
+
+/* Queue length bytes at data behind what was sent before. */
+void colm_parser_send( struct colm_program *prg, struct colm_parser *parser,
+		const char *data, long length );
+
+/* Parse what has been sent. Returns COLM_PARSE_MORE when all of it is used
+ * and the parse waits for more, COLM_PARSE_DONE once the input ended with
+ * colm_parser_finish has been parsed, or COLM_PARSE_ERROR. */
+int colm_parser_run( struct colm_program *prg, struct colm_parser *parser );
+
+/* End the input and parse the rest. Returns the tree, which belongs to the
+ * parser, or zero on a parse error. */
+struct colm_tree *colm_parser_finish( struct colm_program *prg, struct colm_parser *parser );
+
+/* Message of the parse error, zero if there is none. */
+const char *colm_parser_error( struct colm_program *prg,
+		struct colm_parser *parser, int *length );
+
+/* Free the parser, its input and its tree. */
+void colm_parser_close( struct colm_program *prg, struct colm_parser *parser );
+
 const char **colm_extract_fns( struct colm_program *prg );
 
 #ifdef __cplusplus
@@ -58,16 +58,16 @@ free_tree:
 		vm_push_ptree( pt->next );
 	}
 
-	if ( pt->left_ignore != 0 ) {
-		vm_push_ptree( pt->left_ignore );
+	if ( pt->ext != 0 && pt->ext->left_ignore != 0 ) {
+		vm_push_ptree( pt->ext->left_ignore );
 	}
 
 	if ( pt->child != 0 ) {
 		vm_push_ptree( pt->child );
 	}
 
-	if ( pt->right_ignore != 0 ) {
-		vm_push_ptree( pt->right_ignore );
+	if ( pt->ext != 0 && pt->ext->right_ignore != 0 ) {
+		vm_push_ptree( pt->ext->right_ignore );
 	}
 
 	/* Only the root level of the stack has tree 
@@ -87,6 +87,68 @@ static int been_committed( parse_tree_t *parse_tree )
 	return parse_tree->flags & PF_COMMITTED;
 }
 
+/* Without a reducer the data trees are the result of the parse and must
+ * stay. The parse trees below a commit point are only there so reductions
+ * can be undone, which can no longer happen. */
+void commit_clear_undo( program_t *prg, tree_t **root, struct pda_run *pda_run )
+{
+	tree_t **sp = root;
+	parse_tree_t *pt = pda_run->stack_top;
+
+	while ( pt != 0 && !been_committed( pt ) ) {
+		commit_clear_parse_tree( prg, sp, pda_run, pt->child );
+		pt->child = 0;
+
+		pt->flags |= PF_COMMITTED;
+		pt = pt->next;
+	}
+}
+
+/* Hand the committed top-level trees to the commit print handler and keep
+ * only a hollow tree of the same type in the stack. Output has to go out in
+ * order, so this stops at the first token from the bottom. A token there is
+ * part of an unfinished production, whose reduction action would find its
+ * children gone. The top of the stack is held back as well, since trailing
+ * ignores still get attached to it and the token list refers to it. */
+void commit_print( program_t *prg, tree_t **root, struct pda_run *pda_run )
+{
+	tree_t **sp = root;
+	parse_tree_t *pt = pda_run->stack_top;
+
+	if ( pt == 0 )
+		return;
+
+	/* Skip the top and stop at the sentinal at the bottom. */
+	pt = pt->next;
+	while ( pt != 0 && pt->next != 0 && !( pt->flags & PF_STREAMED ) ) {
+		vm_push_ptree( pt );
+		pt = pt->next;
+	}
+
+	while ( sp != root ) {
+		pt = vm_pop_ptree();
+		if ( pt->id < prg->rtd->first_non_term_id ) {
+			sp = root;
+			break;
+		}
+
+		tree_t *tree = pt->shadow->tree;
+		prg->commit_print( prg, sp, tree, prg->commit_print_arg );
+
+		tree_t *hollow = tree_allocate( prg );
+		hollow->id = tree->id;
+		hollow->prod_num = tree->prod_num;
+		hollow->refs = 1;
+		hollow->child = alloc_attrs( prg,
+				prg->rtd->lel_info[tree->id].object_length );
+
+		colm_tree_downref( prg, sp, tree );
+		pt->shadow->tree = hollow;
+
+		pt->flags |= PF_STREAMED;
+	}
+}
+
 void commit_reduce( program_t *prg, tree_t **root, struct pda_run *pda_run )
 {
 	tree_t **sp = root;
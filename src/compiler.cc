@@ -1137,6 +1137,138 @@ void Compiler::writeHostCall()
 
 }
 
+int Compiler::matchNodeDepth( long node )
+{
+	struct pat_cons_node *nodes = runtimeData->pat_repl_nodes;
+
+	int depth = 0;
+	if ( !nodes[node].stop && nodes[node].id >= runtimeData->first_non_term_id ) {
+		for ( long c = nodes[node].child; c != -1; c = nodes[c].next ) {
+			int d = 1 + matchNodeDepth( c );
+			if ( d > depth )
+				depth = d;
+		}
+
+		/* A leaf still moves to its (empty) child list. */
+		if ( depth == 0 )
+			depth = 1;
+	}
+	return depth;
+}
+
+/* Writes the checks for one pattern node against the kid in k<depth>. Nodes
+ * are checked in the order the bind ids were given out in. */
+void Compiler::writeMatchNode( long node, int depth )
+{
+	struct pat_cons_node *nodes = runtimeData->pat_repl_nodes;
+	struct pat_cons_node &n = nodes[node];
+
+	*outStream <<
+		"	if ( k" << depth << " == 0 || k" << depth << "->tree->id != " << n.id << " )\n"
+		"		return 0;\n";
+
+	if ( n.data != 0 ) {
+		*outStream <<
+			"	if ( !match_text( k" << depth << "->tree, \"";
+		escapeLiteralString( *outStream, n.data, n.length );
+		*outStream << "\", " << n.length << " ) )\n"
+			"		return 0;\n";
+	}
+
+	if ( n.bind_id > 0 ) {
+		*outStream <<
+			"	bindings[" << n.bind_id << "] = k" << depth << "->tree;\n";
+	}
+
+	/* Tokens never have children. */
+	if ( !n.stop && n.id >= runtimeData->first_non_term_id ) {
+		/* The id is known here, so skipping the attributes to get to the
+		 * first child can be unrolled. */
+		int c = depth + 1;
+		*outStream <<
+			"	k" << c << " = k" << depth << "->tree->child;\n"
+			"	if ( k" << depth << "->tree->flags & AF_LEFT_IGNORE )\n"
+			"		k" << c << " = k" << c << "->next;\n"
+			"	if ( k" << depth << "->tree->flags & AF_RIGHT_IGNORE )\n"
+			"		k" << c << " = k" << c << "->next;\n";
+
+		long objectLength = runtimeData->lel_info[n.id].object_length;
+		for ( long a = 0; a < objectLength; a++ ) {
+			*outStream <<
+				"	k" << c << " = k" << c << "->next;\n";
+		}
+
+		for ( long child = n.child; child != -1; child = nodes[child].next ) {
+			writeMatchNode( child, c );
+			*outStream <<
+				"	k" << c << " = k" << c << "->next;\n";
+		}
+
+		*outStream <<
+			"	if ( k" << c << " != 0 )\n"
+			"		return 0;\n";
+	}
+}
+
+/*
+ * Each pattern is compiled to a C function that checks the tree against the
+ * pattern nodes, with the ids, text and attribute counts filled in.
+ */
+void Compiler::writeMatchPatterns()
+{
+	*outStream <<
+		"static inline int match_text( tree_t *tree, const char *data, long length )\n"
+		"{\n"
+		"	head_t *head = tree->tokdata;\n"
+		"	if ( ( head == 0 ? 0 : head->length ) != length )\n"
+		"		return 0;\n"
+		"	return length == 0 || memcmp( head->data, data, length ) == 0;\n"
+		"}\n"
+		"\n";
+
+	for ( PatList::Iter pat = patternList; pat.lte(); pat++ ) {
+		long root = runtimeData->pat_repl_info[pat->patRepId].offset;
+		int depth = matchNodeDepth( root );
+
+		*outStream <<
+			"static int match_pattern_" << pat->patRepId <<
+					"( program_t *prg, tree_t **bindings, kid_t *k0 )\n"
+			"{\n";
+
+		if ( depth > 0 ) {
+			*outStream << "	kid_t ";
+			for ( int d = 1; d <= depth; d++ )
+				*outStream << ( d > 1 ? ", " : "" ) << "*k" << d;
+			*outStream << ";\n";
+		}
+
+		writeMatchNode( root, 0 );
+
+		*outStream <<
+			"	return 1;\n"
+			"}\n"
+			"\n";
+	}
+
+	*outStream <<
+		"int " << objectName << "_match_pattern( program_t *prg, long pattern_id,\n"
+		"		tree_t **bindings, kid_t *kid )\n"
+		"{\n"
+		"	switch ( pattern_id ) {\n";
+
+	for ( PatList::Iter pat = patternList; pat.lte(); pat++ ) {
+		*outStream <<
+			"		case " << pat->patRepId << ":\n"
+			"			return match_pattern_" << pat->patRepId << "( prg, bindings, kid );\n";
+	}
+
+	*outStream <<
+		"	}\n"
+		"	return 0;\n"
+		"}\n"
+		"\n";
+}
+
 void Compiler::generateOutput( long activeRealm, bool includeCommit )
 {
 	FsmCodeGen *fsmGen = new FsmCodeGen( *outStream, redFsm, fsmTables );
@@ -1154,6 +1286,7 @@ void Compiler::generateOutput( long activeRealm, bool includeCommit )
 	pdaGen->writeRuntimeData( runtimeData, pdaTables );
 
 	writeHostCall();
+	writeMatchPatterns();
 
 	if ( includeCommit )
 		writeCommitStub();
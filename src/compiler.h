@@ -101,6 +101,13 @@ inline long makeReduceCode( long reduction, bool isShiftReduce )
 		( reduction << 2 );
 }
 
+/* Entry in the row-displaced transition table while it is built. */
+struct pda_ind
+{
+	int owner;
+	int index;
+};
+
 struct ProdEl;
 struct ProdElList;
 struct PdaLiteral;
@@ -314,6 +321,10 @@ struct LangEl : public DListEl<LangEl>
 	bool noPostIgnore;
 	bool isZero;
 	RegionSet *regionSet;
+
+	/* Trees of this type can be cast from another type or assigned from an
+	 * any value, so the grammar does not tell what can be below them. */
+	bool unknownContents;
 };
 
 struct ProdEl
@@ -717,8 +728,8 @@ struct Compiler
 	bool makeFirstSetProd( Production *prod, PdaState *state );
 	void makeFirstSets();
 
-	int findIndexOff( struct pda_tables *pdaTables, PdaGraph *pdaGraph,
-			PdaState *state, int &currLen );
+	int findIndexOff( struct pda_ind *indicies, PdaGraph *pdaGraph,
+			PdaState *state, int firstFree, int &currLen );
 	void trySetTime( PdaTrans *trans, long code, long &time );
 	void addRegion( PdaState *tabState, PdaTrans *pdaTrans, long pdaKey,
 			bool noPreIgnore, bool noPostIgnore );
@@ -771,7 +782,9 @@ struct Compiler
 	struct pda_tables *makePdaTables( PdaGraph *pdaGraph );
 
 	void fillInPatterns( program_t *prg );
+	enum KEY_CMP keyCmp( UniqueType *keyUt );
 	void makeRuntimeData();
+	void makeContainsSets( struct colm_sections *runtimeData );
 
 	/* Generate and write out the fsm. */
 	void generateGraphviz();
@@ -792,8 +805,10 @@ struct Compiler
 
 	void initMapFields( GenericType *gen );
 	void initMapFunctions( GenericType *gen );
+	void initHashMapFunctions( GenericType *gen );
 
 	void initVectorFunctions( GenericType *gen );
+	void initVectorFields( GenericType *gen );
 	void initParserField( GenericType *gen, const char *name,
 			int offset, TypeRef *typeRef );
 	void initParserFunctions( GenericType *gen );
@@ -1074,6 +1089,9 @@ struct Compiler
 	void writePostfixReduce();
 
 	void writeHostCall();
+	int matchNodeDepth( long node );
+	void writeMatchNode( long node, int depth );
+	void writeMatchPatterns();
 	void writeNeeds();
 	void writeCommit();
 	void writeReduceStructs();
@@ -257,6 +257,7 @@ input_funcs_ct pat_funcs =
 {
 	&pat_get_parse_block,
 	&pat_get_data,
+	0, /* get_data_pointer */
 
 	&pat_consume_data,
 	&pat_undo_consume_data,
@@ -474,6 +475,7 @@ input_funcs_ct repl_funcs =
 {
 	&repl_get_parse_block,
 	&repl_get_data,
+	0, /* get_data_pointer */
 
 	&repl_consume_data,
 	&repl_undo_consume_data,
@@ -383,10 +383,11 @@ void GenericType::declare( Compiler *pd, Namespace *nspace )
 {
 	elUt = elTr->resolveType( pd );
  
-	if ( typeId == GEN_MAP )
+	if ( typeId == GEN_MAP || typeId == GEN_HASHMAP )
 		keyUt = keyTr->resolveType( pd );
 	
-	if ( typeId == GEN_MAP || typeId == GEN_LIST )
+	if ( typeId == GEN_MAP || typeId == GEN_HASHMAP ||
+			typeId == GEN_LIST || typeId == GEN_VECTOR )
 		valueUt = valueTr->resolveType( pd );
 	
 	objDef = ObjectDef::cons( ObjectDef::BuiltinType, 
@@ -397,10 +398,18 @@ void GenericType::declare( Compiler *pd, Namespace *nspace )
 			pd->initMapFunctions( this );
 			pd->initMapFields( this );
 			break;
+		case GEN_HASHMAP:
+			pd->initHashMapFunctions( this );
+			pd->initMapFields( this );
+			break;
 		case GEN_LIST:
 			pd->initListFunctions( this );
 			pd->initListFields( this );
 			break;
+		case GEN_VECTOR:
+			pd->initVectorFunctions( this );
+			pd->initVectorFields( this );
+			break;
 		case GEN_PARSER:
 			elUt->langEl->parserId = pd->nextParserId++;
 			pd->initParserFunctions( this );
@@ -1271,6 +1280,50 @@ void Compiler::initMapFunctions( GenericType *gen )
 
 	initFunction( gen->elUt, gen->objDef, ObjectMethod::Call, "detach_el", 
 			FN_MAP_DETACH_WV, FN_MAP_DETACH_WC, gen->elUt, false, true, gen );
+
+	/*
+	 * Bulk and range functions.
+	 */
+	UniqueType *mapUt = findUniqueType( TYPE_GENERIC, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "append", 
+			FN_VMAP_APPEND_WV, FN_VMAP_APPEND_WC, gen->keyUt, gen->valueUt,
+			false, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "union", 
+			FN_MAP_UNION_WV, FN_MAP_UNION_WC, mapUt, false, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "intersect", 
+			FN_MAP_INTERSECT_WV, FN_MAP_INTERSECT_WC, mapUt, false, true, gen );
+
+	initFunction( gen->elUt, gen->objDef, ObjectMethod::Call, "lower_bound", 
+			FN_MAP_LOWER_BOUND, FN_MAP_LOWER_BOUND, gen->keyUt, true, true, gen );
+}
+
+void Compiler::initHashMapFunctions( GenericType *gen )
+{
+	/* Value functions. */
+	initFunction( gen->valueUt, gen->objDef, ObjectMethod::Call, "find", 
+			FN_HMAP_FIND,      FN_HMAP_FIND, gen->keyUt, true, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "insert", 
+			FN_HMAP_INSERT_WV, FN_HMAP_INSERT_WC, gen->keyUt, gen->valueUt,
+			false, true, gen );
+
+	initFunction( gen->elUt, gen->objDef, ObjectMethod::Call, "remove", 
+			FN_HMAP_REMOVE_WV, FN_HMAP_REMOVE_WC, gen->keyUt, false, true, gen );
+
+	/*
+	 * Element Functions
+	 */
+	initFunction( gen->elUt, gen->objDef, ObjectMethod::Call, "find_el", 
+			FN_HMAP_FIND_EL,      FN_HMAP_FIND_EL, gen->keyUt, true, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "insert_el", 
+			FN_HMAP_INSERT_EL_WV, FN_HMAP_INSERT_EL_WC, gen->elUt, false, true, gen );
+
+	initFunction( gen->elUt, gen->objDef, ObjectMethod::Call, "detach_el", 
+			FN_HMAP_DETACH_EL_WV, FN_HMAP_DETACH_EL_WC, gen->elUt, false, true, gen );
 }
 
 void Compiler::initMapField( GenericType *gen, const char *name, int offset )
@@ -1305,6 +1358,11 @@ void Compiler::initMapFields( GenericType *gen )
 	initMapField( gen, "head_el", 0 );
 	initMapField( gen, "tail_el", 1 );
 
+	/* A map and a hashmap of the same types share the element, which
+	 * needs its fields only once. */
+	if ( gen->el->mapKeyField != 0 )
+		return;
+
 	initMapElKey( gen, "key", 0 );
 
 	initMapElField( gen, "prev", 0 );
@@ -1386,6 +1444,30 @@ void Compiler::initListFunctions( GenericType *gen )
 			FN_LIST_POP_HEAD_WV, FN_LIST_POP_HEAD_WC, false, true, gen );
 }
 
+void Compiler::initVectorFunctions( GenericType *gen )
+{
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "push", 
+			FN_VECTOR_PUSH_WV, FN_VECTOR_PUSH_WC, gen->valueUt, false, true, gen );
+
+	initFunction( gen->valueUt, gen->objDef, ObjectMethod::Call, "pop", 
+			FN_VECTOR_POP_WV, FN_VECTOR_POP_WC, false, true, gen );
+
+	initFunction( gen->valueUt, gen->objDef, ObjectMethod::Call, "get", 
+			FN_VECTOR_GET, FN_VECTOR_GET, uniqueTypeInt, true, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "set", 
+			FN_VECTOR_SET_WV, FN_VECTOR_SET_WC, uniqueTypeInt, gen->valueUt,
+			false, true, gen );
+
+	initFunction( uniqueTypeInt, gen->objDef, ObjectMethod::Call, "sort", 
+			FN_VECTOR_SORT_WV, FN_VECTOR_SORT_WC, false, true, gen );
+}
+
+void Compiler::initVectorFields( GenericType *gen )
+{
+	addLengthField( gen->objDef, IN_VECTOR_LENGTH );
+}
+
 void Compiler::initListElField( GenericType *gen, const char *name, int offset )
 {
 	/* Make the type ref and create the field. */
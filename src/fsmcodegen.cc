@@ -25,6 +25,7 @@
 #include <stdbool.h>
 
 #include <sstream>
+#include <fstream>
 #include <iostream>
 
 #include "fsmcodegen.h"
@@ -460,6 +461,63 @@ void FsmCodeGen::emitSingleSwitch( RedState *state )
 	}
 }
 
+/* Emit a range transition. When generating a profile the hit is counted
+ * before taking it. */
+std::ostream &FsmCodeGen::RANGE_GOTO( RedState *state, int pos, int level )
+{
+	RedTrans *trans = state->outRange.data[pos].value;
+	if ( scanProfileGenFn == 0 )
+		return TRANS_GOTO( trans, level );
+
+	out << TABS(level) << "{ " << PROF_RANGE() << "[" <<
+			state->profRangeOff + pos << "] += 1; ";
+	TRANS_GOTO( trans, 0 ) << " }";
+	return out;
+}
+
+/* Test the ranges that took at least a quarter of the profiled visits to a
+ * state ahead of the singles and the binary search. They stay in the search
+ * as well, so this only changes the order of the tests. */
+void FsmCodeGen::emitHotRanges( RedState *state )
+{
+	int numRanges = state->outRange.length();
+	if ( numRanges < 2 || state->profRangeHits.length() != numRanges )
+		return;
+
+	/* At most four ranges can each take a quarter. Keep them hottest first. */
+	int hot[4], numHot = 0;
+	for ( int r = 0; r < numRanges && numHot < 4; r++ ) {
+		unsigned long hits = state->profRangeHits[r];
+		if ( hits == 0 || hits < state->profVisits / 4 )
+			continue;
+
+		int pos = numHot++;
+		while ( pos > 0 && state->profRangeHits[hot[pos-1]] < hits ) {
+			hot[pos] = hot[pos-1];
+			pos -= 1;
+		}
+		hot[pos] = r;
+	}
+
+	for ( int h = 0; h < numHot; h++ ) {
+		RedTransEl *el = state->outRange.data + hot[h];
+		bool limitLow = el->lowKey == keyOps->minKey;
+		bool limitHigh = el->highKey == keyOps->maxKey;
+
+		out << "\tif ( ";
+		if ( !limitLow )
+			out << KEY(el->lowKey) << " <= " << GET_WIDE_KEY(state);
+		if ( !limitLow && !limitHigh )
+			out << " && ";
+		if ( !limitHigh )
+			out << GET_WIDE_KEY(state) << " <= " << KEY(el->highKey);
+		if ( limitLow && limitHigh )
+			out << "1";
+		out << " )\n";
+		RANGE_GOTO( state, hot[h], 2 ) << "\n";
+	}
+}
+
 void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high )
 {
 	/* Get the mid position, staying on the lower end of the range. */
@@ -483,7 +541,7 @@ void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high
 				KEY(data[mid].highKey) << " ) {\n";
 		emitRangeBSearch( state, level+1, mid+1, high );
 		out << TABS(level) << "} else\n";
-		TRANS_GOTO(data[mid].value, level+1) << "\n";
+		RANGE_GOTO( state, mid, level+1 ) << "\n";
 	}
 	else if ( anyLower && !anyHigher ) {
 		/* Can go lower than mid but not higher. */
@@ -495,12 +553,12 @@ void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high
 		 * sense testing it. */
 		if ( limitHigh ) {
 			out << TABS(level) << "} else\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 		else {
 			out << TABS(level) << "} else if ( " << GET_WIDE_KEY(state) << " <= " << 
 					KEY(data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 	}
 	else if ( !anyLower && anyHigher ) {
@@ -513,12 +571,12 @@ void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high
 		 * sense testing it. */
 		if ( limitLow ) {
 			out << TABS(level) << "} else\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 		else {
 			out << TABS(level) << "} else if ( " << GET_WIDE_KEY(state) << " >= " << 
 					KEY(data[mid].lowKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 	}
 	else {
@@ -528,21 +586,21 @@ void FsmCodeGen::emitRangeBSearch( RedState *state, int level, int low, int high
 			out << TABS(level) << "if ( " << KEY(data[mid].lowKey) << " <= " << 
 					GET_WIDE_KEY(state) << " && " << GET_WIDE_KEY(state) << " <= " << 
 					KEY(data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 		else if ( limitLow && !limitHigh ) {
 			out << TABS(level) << "if ( " << GET_WIDE_KEY(state) << " <= " << 
 					KEY(data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 		else if ( !limitLow && limitHigh ) {
 			out << TABS(level) << "if ( " << KEY(data[mid].lowKey) << " <= " << 
 					GET_WIDE_KEY(state) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 		else {
 			/* Both high and low are at the limit. No tests to do. */
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			RANGE_GOTO( state, mid, level+1 ) << "\n";
 		}
 	}
 }
@@ -556,6 +614,9 @@ std::ostream &FsmCodeGen::STATE_GOTOS()
 			/* Writing code above state gotos. */
 			GOTO_HEADER( st );
 
+			/* Profiled hot ranges go first. */
+			emitHotRanges( st );
+
 			/* Try singles. */
 			if ( st->outSingle.length() > 0 )
 				emitSingleSwitch( st );
@@ -685,6 +746,9 @@ void FsmCodeGen::GOTO_HEADER( RedState *state )
 		"	if ( ++" << P() << " == " << PE() << " )\n"
 		"		goto out" << state->id << ";\n";
 
+	if ( scanProfileGenFn != 0 )
+		out << "	" << PROF_STATE() << "[" << state->id << "] += 1;\n";
+
 	if ( state->fromStateAction != 0 ) {
 		/* Remember that we wrote an action. Write every action in the list. */
 		for ( GenActionTable::Iter item = state->fromStateAction->key; item.lte(); item++ )
@@ -826,6 +890,149 @@ void FsmCodeGen::writeData()
 		"\n";
 }
 
+int FsmCodeGen::profRanges()
+{
+	int numRanges = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		numRanges += st->outRange.length();
+	return numRanges;
+}
+
+/* Load a profile written by a scanner generated with -p. States are
+ * identified by id and ranges by their low key, so the profile is only
+ * accepted if it came from the same grammar. */
+bool FsmCodeGen::readProfile()
+{
+	std::ifstream in( scanProfileUseFn );
+	if ( !in.is_open() ) {
+		warning() << "could not open scanner profile " <<
+				scanProfileUseFn << ", ignoring it" << endl;
+		return false;
+	}
+
+	string magic;
+	long numStates = -1, numRanges = -1;
+	in >> magic >> numStates >> numRanges;
+	if ( !in || magic != "colm-scan-profile" ||
+			numStates != redFsm->nextStateId || numRanges != profRanges() )
+	{
+		warning() << "scanner profile " << scanProfileUseFn <<
+				" does not match this program, ignoring it" << endl;
+		return false;
+	}
+
+	RedState **byId = new RedState*[numStates];
+	memset( byId, 0, sizeof(RedState*) * numStates );
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		byId[st->id] = st;
+		st->profVisits = 0;
+		st->profRangeHits.empty();
+		for ( int r = 0; r < st->outRange.length(); r++ )
+			st->profRangeHits.append( 0 );
+	}
+
+	char kind;
+	long id, low;
+	unsigned long count;
+	while ( in >> kind ) {
+		if ( kind == 's' && in >> id >> count ) {
+			if ( 0 <= id && id < numStates && byId[id] != 0 )
+				byId[id]->profVisits = count;
+		}
+		else if ( kind == 'r' && in >> id >> low >> count ) {
+			if ( 0 <= id && id < numStates && byId[id] != 0 ) {
+				RedState *state = byId[id];
+				for ( int r = 0; r < state->outRange.length(); r++ ) {
+					if ( state->outRange[r].lowKey.getVal() == low )
+						state->profRangeHits[r] = count;
+				}
+			}
+		}
+		else {
+			warning() << "scanner profile " << scanProfileUseFn <<
+					" is malformed, using what was read" << endl;
+			break;
+		}
+	}
+
+	delete[] byId;
+	return true;
+}
+
+/* Counters for a profiling scanner and the function that writes them out
+ * when the program exits. */
+void FsmCodeGen::writeProfileData()
+{
+	int numRanges = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->profRangeOff = numRanges;
+		numRanges += st->outRange.length();
+	}
+
+	/* Zero length arrays are not allowed. */
+	int rangeLen = numRanges > 0 ? numRanges : 1;
+
+	out <<
+		"static unsigned long " << PROF_STATE() << "[" << redFsm->nextStateId << "];\n"
+		"static unsigned long " << PROF_RANGE() << "[" << rangeLen << "];\n"
+		"static const int " << PROF_RANGE() << "_state[] = {\n\t";
+
+	int item = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( int r = 0; r < st->outRange.length(); r++ ) {
+			out << st->id << ", ";
+			if ( ++item % IALL == 0 )
+				out << "\n\t";
+		}
+	}
+
+	out <<
+		"0\n};\n"
+		"static const long " << PROF_RANGE() << "_low[] = {\n\t";
+
+	item = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( int r = 0; r < st->outRange.length(); r++ ) {
+			out << KEY( st->outRange[r].lowKey ) << ", ";
+			if ( ++item % IALL == 0 )
+				out << "\n\t";
+		}
+	}
+
+	out << "0\n};\n\n";
+
+	out <<
+		"static void " << PROF_STATE() << "_write( void )\n"
+		"{\n"
+		"	int i;\n"
+		"	FILE *file = fopen( \"";
+
+	for ( const char *c = scanProfileGenFn; *c != 0; c++ ) {
+		if ( *c == '\\' || *c == '"' )
+			out << '\\';
+		out << *c;
+	}
+
+	out << "\", \"w\" );\n"
+		"	if ( file == 0 )\n"
+		"		return;\n"
+		"	fprintf( file, \"colm-scan-profile %d %d\\n\", " <<
+				redFsm->nextStateId << ", " << numRanges << " );\n"
+		"	for ( i = 0; i < " << redFsm->nextStateId << "; i++ ) {\n"
+		"		if ( " << PROF_STATE() << "[i] > 0 )\n"
+		"			fprintf( file, \"s %d %lu\\n\", i, " << PROF_STATE() << "[i] );\n"
+		"	}\n"
+		"	for ( i = 0; i < " << numRanges << "; i++ ) {\n"
+		"		if ( " << PROF_RANGE() << "[i] > 0 )\n"
+		"			fprintf( file, \"r %d %ld %lu\\n\", " <<
+						PROF_RANGE() << "_state[i], " << PROF_RANGE() << "_low[i], " <<
+						PROF_RANGE() << "[i] );\n"
+		"	}\n"
+		"	fclose( file );\n"
+		"}\n"
+		"\n";
+}
+
 void FsmCodeGen::writeInit()
 {
 	out << 
@@ -850,7 +1057,20 @@ void FsmCodeGen::writeExec()
 	out <<
 		"static void fsm_execute( struct pda_run *pdaRun, struct input_impl *inputStream )\n"
 		"{\n"
-		"	" << BLOCK_START() << " = pdaRun->p;\n"
+		"	" << BLOCK_START() << " = pdaRun->p;\n";
+
+	if ( scanProfileGenFn != 0 ) {
+		out <<
+			"	{\n"
+			"		static int registered = 0;\n"
+			"		if ( !registered ) {\n"
+			"			registered = 1;\n"
+			"			atexit( " << PROF_STATE() << "_write );\n"
+			"		}\n"
+			"	}\n";
+	}
+
+	out <<
 		"/*_resume:*/\n";
 
 	if ( redFsm->errState != 0 ) {
@@ -894,7 +1114,13 @@ void FsmCodeGen::writeCode()
 {
 	redFsm->depthFirstOrdering();
 
+	/* With a profile, hot states are grouped at the front. */
+	if ( scanProfileUseFn != 0 && readProfile() )
+		redFsm->sortByProfile();
+
 	writeData();
+	if ( scanProfileGenFn != 0 )
+		writeProfileData();
 	writeExec();
 
 	/* Referenced in the runtime lib, but used only in the compiler. Probably
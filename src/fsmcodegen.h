@@ -119,6 +119,8 @@ protected:
 	string FIRST_FINAL() { return DATA_PREFIX() + "first_final"; }
 
 	string ENTRY_BY_REGION() { return DATA_PREFIX() + "entry_by_region"; }
+	string PROF_STATE() { return DATA_PREFIX() + "prof_state"; }
+	string PROF_RANGE() { return DATA_PREFIX() + "prof_range"; }
 
 
 	void INLINE_LIST( ostream &ret, InlineList *inlineList, 
@@ -180,7 +182,13 @@ public:
 	void STATE_CONDS( RedState *state, bool genDefault ); 
 
 	void emitSingleSwitch( RedState *state );
+	void emitHotRanges( RedState *state );
 	void emitRangeBSearch( RedState *state, int level, int low, int high );
+	std::ostream &RANGE_GOTO( RedState *state, int pos, int level );
+
+	int profRanges();
+	bool readProfile();
+	void writeProfileData();
 
 	std::ostream &EXIT_STATES();
 	std::ostream &TRANS_GOTO( RedTrans *trans, int level );
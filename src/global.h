@@ -68,6 +68,14 @@ extern bool gblLibrary;
 extern long gblActiveRealm;
 extern char machineMain[];
 extern const char *exportHeaderFn;
+extern const char *scanProfileGenFn;
+extern const char *scanProfileUseFn;
+extern long autoCommit;
+extern bool iterIndex;
+extern bool treeHash;
+extern bool shareTokens;
+extern bool readAhead;
+extern bool commitPrint;
 
 struct colm_location;
 
@@ -104,6 +112,7 @@ void checkMachines( );
 void xmlEscapeHost( std::ostream &out, char *data, int len );
 void openOutput();
 void escapeLiteralString( std::ostream &out, const char *data );
+void escapeLiteralString( std::ostream &out, const char *data, int length );
 bool readCheck( const char *fn );
 
 #endif /* _COLM_GLOBAL_H */
@@ -350,6 +350,28 @@ static int input_get_data( struct colm_program *prg, struct input_impl_seq *is,
 	return copied;
 }
 
+/* Pointer to the next length bytes when they lie in one stream that can hand
+ * out data outliving the stream. Otherwise zero and the caller copies the
+ * data with get_data. */
+static const char *input_get_data_pointer( struct colm_program *prg, struct input_impl_seq *is, int length )
+{
+	struct seq_buf *buf = is->queue.head;
+	while ( buf != 0 && is_stream( buf ) ) {
+		struct stream_impl *si = buf->si;
+		if ( si->funcs->get_data_pointer == 0 )
+			break;
+
+		const char *data = 0;
+		int avail = si->funcs->get_data_pointer( prg, si, &data, length );
+		if ( avail > 0 )
+			return avail == length ? data : 0;
+
+		buf = buf->next;
+	}
+
+	return 0;
+}
+
 /*
  * Consume
  */
@@ -369,9 +391,13 @@ static int input_consume_data( struct colm_program *prg, struct input_impl_seq *
 
 		if ( is_stream( buf ) ) {
 			struct stream_impl *sub = buf->si;
+			int was_set = loc->line != 0;
 			int slen = sub->funcs->consume_data( prg, sub, length, loc );
 			//debug( REALM_INPUT, " got %d bytes from source\n", slen );
 
+			if ( !was_set && loc->line != 0 )
+				loc->input_byte = si->consumed + consumed;
+
 			consumed += slen;
 			length -= slen;
 		}
@@ -392,6 +418,7 @@ static int input_consume_data( struct colm_program *prg, struct input_impl_seq *
 		input_stream_stash_head( prg, si, seq_buf );
 	}
 
+	si->consumed += consumed;
 	return consumed;
 }
 
@@ -421,6 +448,7 @@ static int input_undo_consume_data( struct colm_program *prg, struct input_impl_
 		input_stream_seq_prepend( si, b );
 	}
 
+	si->consumed -= tot;
 	return tot;
 }
 
@@ -655,6 +683,7 @@ struct input_funcs_seq input_funcs =
 {
 	&input_get_parse_block,
 	&input_get_data,
+	&input_get_data_pointer,
 
 	/* Consume. */
 	&input_consume_data,
@@ -720,6 +749,19 @@ input_t *colm_input_new( program_t *prg )
 	return input;
 }
 
+/* Queue a stream that the input destroys along with itself. */
+void colm_input_append_impl( program_t *prg, input_t *input, struct stream_impl *impl )
+{
+	struct input_impl_seq *si = (struct input_impl_seq*)input->impl;
+
+	struct seq_buf *buf = new_seq_buf();
+	buf->type = SB_SOURCE;
+	buf->si = impl;
+	buf->own_si = 1;
+
+	input_stream_seq_append( si, buf );
+}
+
 struct input_impl *input_to_impl( input_t *ptr )
 {
 	return ptr->impl;
@@ -58,6 +58,7 @@ struct input_funcs \
 { \
 	int (*get_parse_block)( struct colm_program *prg, struct _input_impl *si, int *pskip, char **pdp, int *copied ); \
 	int (*get_data)( struct colm_program *prg, struct _input_impl *si, char *dest, int length ); \
+	const char *(*get_data_pointer)( struct colm_program *prg, struct _input_impl *si, int length ); \
 	int (*consume_data)( struct colm_program *prg, struct _input_impl *si, int length, struct colm_location *loc ); \
 	int (*undo_consume_data)( struct colm_program *prg, struct _input_impl *si, const char *data, int length ); \
 	struct colm_tree *(*consume_tree)( struct colm_program *prg, struct _input_impl *si ); \
@@ -86,6 +87,7 @@ struct stream_funcs \
 { \
 	int (*get_parse_block)( struct colm_program *prg, struct _stream_impl *si, int *pskip, char **pdp, int *copied ); \
 	int (*get_data)( struct colm_program *prg, struct _stream_impl *si, char *dest, int length ); \
+	int (*get_data_pointer)( struct colm_program *prg, struct _stream_impl *si, const char **pdp, int length ); \
 	int (*get_data_source)( struct colm_program *prg, struct _stream_impl *si, char *dest, int length ); \
 	int (*consume_data)( struct colm_program *prg, struct _stream_impl *si, int length, struct colm_location *loc ); \
 	int (*undo_consume_data)( struct colm_program *prg, struct _stream_impl *si, const char *data, int length ); \
@@ -148,21 +150,45 @@ struct input_impl_seq
 
 	struct seq_buf *stash;
 
-	int consumed;
+	/* Bytes consumed across all streams. */
+	long consumed;
 };
 
+/* Run buffers hold FSM_BUFSIZE bytes, doubled up to RUN_BUF_CLASSES - 1
+ * times for sources that keep them full. Buffers of these sizes are kept by
+ * the program for reuse, at most RUN_BUF_POOL_MAX of each. */
+#define RUN_BUF_CLASSES 8
+#define RUN_BUF_MAX ( FSM_BUFSIZE << ( RUN_BUF_CLASSES - 1 ) )
+#define RUN_BUF_POOL_MAX 4
+
 struct run_buf
 {
 	long length;
 	long offset;
+	long size;
 	struct run_buf *next, *prev;
 
+	/* Token data points into the buffer, so it must outlive the stream. */
+	char referenced;
+
 	/* Must be at the end. We will grow this struct to add data if the input
 	 * demands it. */
 	char data[FSM_BUFSIZE];
 };
 
-struct run_buf *new_run_buf( int sz );
+struct run_buf *new_run_buf( struct colm_program *prg, long sz );
+void free_run_buf( struct colm_program *prg, struct run_buf *rb );
+
+/* A file mapped by an input stream. */
+struct read_ahead;
+struct decompress;
+
+struct stream_mapping
+{
+	void *base;
+	long length;
+	struct stream_mapping *next;
+};
 
 struct stream_impl_data
 {
@@ -176,7 +202,7 @@ struct stream_impl_data
 
 	const char *data;
 	long dlen;
-	int offset;
+	long offset;
 
 	long line;
 	long column;
@@ -187,19 +213,43 @@ struct stream_impl_data
 
 	struct colm_str_collect *collect;
 
-	int consumed;
+	long consumed;
 
 	/* Indentation. */
 	int level;
 	int indent;
 
+	/* Output of the print in progress. Written to the file when the
+	 * print ends or the buffer fills. */
+	char *out_buf;
+	int out_len;
+
+	/* Column of the newline ending each of the most recent lines, a ring of
+	 * LINE_LEN_HISTORY entries. Restores columns when text is sent back. */
 	int *line_len;
-	int lines_alloc;
+	int lines_head;
 	int lines_cur;
+
+	/* The last run buffer consumed to its end. Text sent back past the
+	 * head of the queue came from it, and it holds what precedes that
+	 * text, so it goes back on the queue instead of a copy. */
+	struct run_buf *consumed_buf;
+
+	/* Helper thread reading the file ahead of the scanner, if any. */
+	struct read_ahead *read_ahead;
+
+	/* Decoder of a compressed file, if any. */
+	struct decompress *decompress;
+
+	/* Size of the run buffers source data is read into. Zero for
+	 * FSM_BUFSIZE. */
+	int bufsize;
 };
 
+#define LINE_LEN_HISTORY 1024
+
 void stream_impl_push_line( struct stream_impl_data *ss, int ll );
-int stream_impl_pop_line( struct stream_impl_data *ss );
+int stream_impl_pop_lines( struct stream_impl_data *ss, long n );
 
 struct input_impl *colm_impl_new_generic( char *name );
 
@@ -213,8 +263,11 @@ struct colm_stream *colm_stream_open_collect( struct colm_program *prg );
 
 char *colm_filename_add( struct colm_program *prg, const char *fn );
 struct stream_impl *colm_impl_new_accum( char *name );
-struct stream_impl *colm_impl_consumed( char *name, int len );
+struct stream_impl *colm_impl_consumed( char *name, long len );
 struct stream_impl *colm_impl_new_text( char *name, const char *data, int len );
+struct stream_impl *colm_impl_new_span( char *name, const char *data, long len,
+		struct stream_impl *prev );
+void colm_release_mappings( struct colm_program *prg );
 
 #ifdef __cplusplus
 }
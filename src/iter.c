@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include <colm/tree.h>
 #include <colm/bytecode.h>
@@ -176,6 +177,341 @@ value_t colm_viter_deref_cur( program_t *prg, generic_iter_t *iter )
 	return value;
 }
 
+/*
+ * Tree indices. The first typed iteration over a tree records where the
+ * matches are, along with the path to each. Later iterations over the same
+ * unchanged tree replay the recording instead of walking the tree.
+ */
+
+/* Most indices kept at once. Each holds a reference to its root, so while
+ * the root is in use elsewhere the index costs only the recording, 24 bytes
+ * per node on the paths to the matches. Once nothing else refers to the root
+ * the index is dropped, letting the tree go. */
+#define TREE_INDEX_MAX 16
+
+/* Walks shorter than this are not worth recording. */
+#define TREE_INDEX_MIN_VISITS 512
+
+static void index_unlink( program_t *prg, struct tree_index *index )
+{
+	if ( index->prev == 0 )
+		prg->index_head = index->next;
+	else
+		index->prev->next = index->next;
+
+	if ( index->next == 0 )
+		prg->index_tail = index->prev;
+	else
+		index->next->prev = index->prev;
+
+	index->prev = index->next = 0;
+	prg->index_count -= 1;
+}
+
+static void index_link_head( program_t *prg, struct tree_index *index )
+{
+	index->prev = 0;
+	index->next = prg->index_head;
+	if ( prg->index_head == 0 )
+		prg->index_tail = index;
+	else
+		prg->index_head->prev = index;
+	prg->index_head = index;
+	prg->index_count += 1;
+}
+
+static void index_free( struct tree_index *index )
+{
+	free( index->els );
+	free( index->matches );
+	free( index->path );
+	free( index->kids );
+	free( index );
+}
+
+/* Take the index out of use. It is freed once no iterator refers to it. */
+static void index_kill( program_t *prg, tree_t **sp, struct tree_index *index )
+{
+	index_unlink( prg, index );
+	index->dead = true;
+
+	tree_t *root = index->root;
+	index->root = 0;
+
+	struct tree_index *other;
+	for ( other = prg->index_head; other != 0; other = other->next ) {
+		if ( other->root == root )
+			break;
+	}
+
+	/* Not indexed while dropping the reference, so it does not come back
+	 * here. */
+	root->flags &= ~AF_INDEXED;
+	colm_tree_downref( prg, sp, root );
+	if ( other != 0 )
+		root->flags |= AF_INDEXED;
+
+	if ( index->users == 0 )
+		index_free( index );
+}
+
+static void index_release( program_t *prg, tree_t **sp, tree_iter_t *iter )
+{
+	struct tree_index *index = iter->index;
+	iter->index = 0;
+
+	index->users -= 1;
+	if ( index->dead ) {
+		if ( index->users == 0 )
+			index_free( index );
+	}
+	else if ( !index->complete ) {
+		/* Recording did not make it to the end. */
+		index_kill( prg, sp, index );
+	}
+}
+
+struct tree_index *colm_tree_index_find( program_t *prg, tree_t *root, long search_id )
+{
+	struct tree_index *index;
+	for ( index = prg->index_head; index != 0; index = index->next ) {
+		if ( index->complete && index->root == root && index->search_id == search_id )
+			return index;
+	}
+	return 0;
+}
+
+/* The tree is being copied for modification. Anything recorded from it will
+ * not see the changes. */
+void colm_tree_index_split( program_t *prg, tree_t **sp, tree_t *tree )
+{
+	struct tree_index *index = prg->index_head;
+	while ( index != 0 ) {
+		struct tree_index *next = index->next;
+		if ( index->root == tree )
+			index_kill( prg, sp, index );
+		index = next;
+	}
+}
+
+/* A reference to an indexed tree was dropped. If the indices hold the only
+ * references left, drop them. */
+void colm_tree_index_unused( program_t *prg, tree_t **sp, tree_t *tree )
+{
+	struct tree_index *index;
+	long held = 0;
+	for ( index = prg->index_head; index != 0; index = index->next ) {
+		if ( index->root == tree )
+			held += 1;
+	}
+
+	if ( held == tree->refs )
+		colm_tree_index_split( prg, sp, tree );
+}
+
+void colm_tree_index_clear( program_t *prg, tree_t **sp )
+{
+	while ( prg->index_head != 0 )
+		index_kill( prg, sp, prg->index_head );
+}
+
+static long index_add_el( struct tree_index *index, kid_t *kid, long parent, long depth )
+{
+	if ( index->els_len == index->els_alloc ) {
+		index->els_alloc = index->els_alloc == 0 ? 64 : index->els_alloc * 2;
+		index->els = (struct tree_index_el*) realloc( index->els,
+				sizeof(struct tree_index_el) * index->els_alloc );
+	}
+
+	struct tree_index_el *el = &index->els[index->els_len];
+	el->kid = kid;
+	el->parent = parent;
+	el->depth = depth;
+	return index->els_len++;
+}
+
+static void index_path_reserve( struct tree_index *index, long len )
+{
+	if ( len > index->path_alloc ) {
+		index->path_alloc = len * 2;
+		index->path = (long*) realloc( index->path, sizeof(long) * index->path_alloc );
+		index->kids = (kid_t**) realloc( index->kids, sizeof(kid_t*) * index->path_alloc );
+	}
+}
+
+/* Start replaying an index for the iterator if there is one. Otherwise, if
+ * an earlier walk over the tree found it worth it, start recording one. */
+static void index_begin( program_t *prg, tree_t **sp, tree_iter_t *iter )
+{
+	tree_t *root = iter->root_ref.kid->tree;
+	struct tree_index *index = colm_tree_index_find( prg, root, iter->search_id );
+	long i;
+
+	iter->visits = 0;
+	iter->matched = 0;
+
+	if ( index != 0 ) {
+		/* Move to the front. */
+		index_unlink( prg, index );
+		index_link_head( prg, index );
+	}
+	else {
+		for ( i = 0; i < TREE_INDEX_SEEN; i++ ) {
+			if ( prg->index_seen[i].root == root &&
+					prg->index_seen[i].search_id == iter->search_id )
+				break;
+		}
+
+		if ( i == TREE_INDEX_SEEN )
+			return;
+
+		prg->index_seen[i].root = 0;
+
+		/* Make room, dropping the least recently used index not in use. */
+		struct tree_index *evict = prg->index_tail;
+		while ( prg->index_count >= TREE_INDEX_MAX && evict != 0 ) {
+			struct tree_index *prev = evict->prev;
+			if ( evict->users == 0 )
+				index_kill( prg, sp, evict );
+			evict = prev;
+		}
+
+		if ( prg->index_count >= TREE_INDEX_MAX )
+			return;
+
+		index = (struct tree_index*) calloc( 1, sizeof(struct tree_index) );
+		index->root = root;
+		index->search_id = iter->search_id;
+		colm_tree_upref( prg, root );
+		root->flags |= AF_INDEXED;
+		index_link_head( prg, index );
+	}
+
+	index->users += 1;
+	iter->index = index;
+	iter->index_pos = -1;
+}
+
+/* A walk without an index finished. Remember the tree if it was long and
+ * found little. Only the address is kept, the tree may go away. */
+static void index_survey( program_t *prg, tree_iter_t *iter )
+{
+	if ( iter->visits >= TREE_INDEX_MIN_VISITS && iter->matched * 4 <= iter->visits ) {
+		struct tree_index_seen *seen = &prg->index_seen[prg->index_seen_next];
+		seen->root = iter->root_ref.kid->tree;
+		seen->search_id = iter->search_id;
+		prg->index_seen_next = ( prg->index_seen_next + 1 ) % TREE_INDEX_SEEN;
+	}
+}
+
+/* The iterator stopped on a match. Add it and any new levels of the path to
+ * it to the recording. */
+static void index_record( program_t *prg, tree_t **sp, tree_iter_t *iter )
+{
+	struct tree_index *index = iter->index;
+	long depth = ( vm_ssize() - iter->root_size ) / 2;
+	long level;
+
+	index_path_reserve( index, depth + 1 );
+
+	/* Levels above the lowest the walk went to since the last match are
+	 * unchanged. The one at the lowest may have moved to a sibling. */
+	long same = iter->low < index->path_len ? iter->low : index->path_len;
+
+	kid_t **kids = index->kids;
+	ref_t *ref = iter->ref.next;
+	for ( level = depth - 1; level >= same; level-- ) {
+		kids[level] = ref->kid;
+		ref = ref->next;
+	}
+	kids[depth] = iter->ref.kid;
+
+	if ( same < depth && same < index->path_len &&
+			index->els[index->path[same]].kid == kids[same] )
+		same += 1;
+
+	for ( level = same; level <= depth; level++ ) {
+		long parent = level == 0 ? -1 : index->path[level-1];
+		index->path[level] = index_add_el( index, kids[level], parent, level );
+	}
+	index->path_len = depth + 1;
+	iter->low = depth;
+
+	if ( index->matches_len == index->matches_alloc ) {
+		index->matches_alloc = index->matches_alloc == 0 ? 64 : index->matches_alloc * 2;
+		index->matches = (long*) realloc( index->matches,
+				sizeof(long) * index->matches_alloc );
+	}
+	index->matches[index->matches_len++] = index->path[depth];
+}
+
+/* The recording iteration reached the end. Keep the index only if it saves
+ * enough walking. */
+static void index_finish( program_t *prg, tree_t **sp, tree_iter_t *iter )
+{
+	struct tree_index *index = iter->index;
+
+	if ( index->els_len * 2 <= iter->visits ) {
+		index->complete = true;
+		index->users -= 1;
+		iter->index = 0;
+	}
+	else {
+		index_release( prg, sp, iter );
+	}
+}
+
+/* Move the iterator to the next recorded match. Pops up to the deepest
+ * common ancestor, then pushes down to the match, leaving the stack as the
+ * walk would. */
+static void index_next( program_t *prg, tree_t ***psp, tree_iter_t *iter )
+{
+	struct tree_index *index = iter->index;
+	struct tree_index_el *els = index->els;
+	tree_t **sp = *psp;
+
+	long cur = iter->index_pos < 0 ? 0 : index->matches[iter->index_pos];
+	iter->index_pos += 1;
+
+	if ( iter->index_pos >= index->matches_len ) {
+		if ( index->matches_len > 0 )
+			vm_popn( els[cur].depth * 2 );
+		iter->ref.kid = 0;
+		*psp = sp;
+		return;
+	}
+
+	long targ = index->matches[iter->index_pos];
+	long anc = targ;
+
+	while ( els[anc].depth > els[cur].depth )
+		anc = els[anc].parent;
+
+	while ( anc != cur ) {
+		iter->ref.kid = vm_pop_kid();
+		iter->ref.next = vm_pop_ref();
+		cur = els[cur].parent;
+		if ( els[anc].depth > els[cur].depth )
+			anc = els[anc].parent;
+	}
+
+	/* Collect the way down, then push it top down. */
+	long n = els[targ].depth - els[cur].depth, i;
+	index_path_reserve( index, n );
+	for ( i = n - 1, anc = targ; i >= 0; i--, anc = els[anc].parent )
+		index->path[i] = anc;
+
+	for ( i = 0; i < n; i++ ) {
+		vm_contiguous( 2 );
+		vm_push_ref( iter->ref.next );
+		vm_push_kid( iter->ref.kid );
+		iter->ref.kid = els[index->path[i]].kid;
+		iter->ref.next = (ref_t*)vm_ptop();
+	}
+
+	*psp = sp;
+}
+
 void colm_init_tree_iter( tree_iter_t *tree_iter, tree_t **stack_root,
 		long arg_size, long root_size,
 		const ref_t *root_ref, int search_id )
@@ -189,6 +525,11 @@ void colm_init_tree_iter( tree_iter_t *tree_iter, tree_t **stack_root,
 	tree_iter->ref.kid = 0;
 	tree_iter->ref.next = 0;
 	tree_iter->arg_size = arg_size;
+	tree_iter->index = 0;
+	tree_iter->index_pos = -1;
+	tree_iter->visits = 0;
+	tree_iter->matched = 0;
+	tree_iter->low = 0;
 }
 
 void colm_init_rev_tree_iter( rev_tree_iter_t *rev_triter, tree_t **stack_root,
@@ -265,6 +606,8 @@ void colm_tree_iter_destroy( program_t *prg, tree_t ***psp, tree_iter_t *iter )
 		long cur_stack_size = vm_ssize() - iter->root_size;
 		assert( iter->yield_size == cur_stack_size );
 		vm_popn( iter->yield_size );
+		if ( iter->index != 0 )
+			index_release( prg, sp, iter );
 		for ( i = 0; i < iter->arg_size; i++ )
 			colm_tree_downref( prg, sp, vm_pop_tree() );
 		iter->type = 0;
@@ -360,20 +703,26 @@ void iter_find( program_t *prg, tree_t ***psp, tree_iter_t *iter, int try_first
 	tree_t **top = iter->stack_root;
 	kid_t *child;
 	tree_t **sp = *psp;
+	long depth = ( vm_ssize() - iter->root_size ) / 2;
 
 rec_call:
+	iter->visits += 1;
 	if ( try_first && ( iter->ref.kid->tree->id == iter->search_id || any_tree ) ) {
 		*psp = sp;
 		return;
 	}
 	else {
-		child = tree_child( prg, iter->ref.kid->tree );
+		/* Skip subtrees the grammar says cannot contain the search type. */
+		child = any_tree || lel_can_contain( prg->rtd->lel_info,
+				iter->ref.kid->tree->id, iter->search_id ) ?
+				tree_child( prg, iter->ref.kid->tree ) : 0;
 		if ( child != 0 ) {
 			vm_contiguous( 2 );
 			vm_push_ref( iter->ref.next );
 			vm_push_kid( iter->ref.kid );
 			iter->ref.kid = child;
 			iter->ref.next = (ref_t*)vm_ptop();
+			depth += 1;
 			while ( iter->ref.kid != 0 ) {
 				try_first = true;
 				goto rec_call;
@@ -382,6 +731,9 @@ rec_call:
 			}
 			iter->ref.kid = vm_pop_kid();
 			iter->ref.next = vm_pop_ref();
+			depth -= 1;
+			if ( depth < iter->low )
+				iter->low = depth;
 		}
 	}
 
@@ -400,7 +752,24 @@ tree_t *tree_iter_advance( program_t *prg, tree_t ***psp, tree_iter_t *iter )
 	if ( iter->ref.kid == 0 ) {
 		/* kid_t is zero, start from the root. */
 		iter->ref = iter->root_ref;
-		iter_find( prg, psp, iter, true );
+
+		if ( prg->iter_index && iter->search_id != prg->rtd->any_id )
+			index_begin( prg, sp, iter );
+
+		if ( iter->index != 0 && iter->index->complete )
+			index_next( prg, psp, iter );
+		else
+			iter_find( prg, psp, iter, true );
+	}
+	else if ( iter->index != 0 && iter->index->complete ) {
+		if ( !iter->index->dead && iter->root_ref.kid->tree == iter->index->root )
+			index_next( prg, psp, iter );
+		else {
+			/* Modified since the last item. Walk from here. */
+			index_release( prg, sp, iter );
+			iter->index_pos = -2;
+			iter_find( prg, psp, iter, false );
+		}
 	}
 	else {
 		/* Have a previous item, continue searching from there. */
@@ -408,6 +777,22 @@ tree_t *tree_iter_advance( program_t *prg, tree_t ***psp, tree_iter_t *iter )
 	}
 
 	sp = *psp;
+
+	if ( iter->index != 0 && !iter->index->complete ) {
+		if ( iter->index->dead || iter->root_ref.kid->tree != iter->index->root )
+			index_release( prg, sp, iter );
+		else if ( iter->ref.kid != 0 )
+			index_record( prg, sp, iter );
+		else
+			index_finish( prg, sp, iter );
+	}
+	else if ( iter->index == 0 && prg->iter_index && iter->index_pos == -1 ) {
+		if ( iter->ref.kid != 0 )
+			iter->matched += 1;
+		else
+			index_survey( prg, iter );
+	}
+
 	iter->yield_size = vm_ssize() - iter->root_size;
 
 	return (iter->ref.kid ? prg->true_val : prg->false_val );
@@ -519,7 +904,9 @@ rec_call:
 		 * root of the iteration, or if does not have any neighbours to the
 		 * right. */
 		if ( top == vm_ptop() || iter->ref.kid->next == 0  ) {
-			child = tree_child( prg, iter->ref.kid->tree );
+			child = any_tree || lel_can_contain( prg->rtd->lel_info,
+					iter->ref.kid->tree->id, iter->search_id ) ?
+					tree_child( prg, iter->ref.kid->tree ) : 0;
 			if ( child != 0 ) {
 				vm_contiguous( 2 );
 				vm_push_ref( iter->ref.next );
@@ -28,6 +28,7 @@
 #include <colm/program.h>
 #include <colm/struct.h>
 #include <colm/bytecode.h>
+#include <colm/map.h>
 
 static void colm_list_add_after( list_t *list, list_el_t *prev_el, list_el_t *new_el );
 static void colm_list_add_before( list_t *list, list_el_t *next_el, list_el_t *new_el);
@@ -253,3 +254,121 @@ struct colm_struct *colm_list_el_get( struct colm_program *prg,
 			colm_struct_container( result, gi->el_offset ) : 0;
 	return s;
 }
+
+/*
+ * Vector. A growable array of values. Tree values are owned by the vector.
+ */
+#define VECTOR_ALLOC_MIN 8
+
+void colm_vector_destroy( struct colm_program *prg, tree_t **sp, struct colm_struct *s )
+{
+	vector_t *vector = (vector_t*) s;
+	if ( vector->generic_info->value_type == TYPE_TREE ) {
+		long i;
+		for ( i = 0; i < vector->len; i++ )
+			colm_tree_downref( prg, sp, (tree_t*)vector->data[i] );
+	}
+	free( vector->data );
+}
+
+vector_t *colm_vector_new( struct colm_program *prg )
+{
+	size_t memsize = sizeof(struct colm_vector);
+	struct colm_vector *vector = (struct colm_vector*) malloc( memsize );
+	memset( vector, 0, memsize );
+	colm_struct_add( prg, (struct colm_struct *)vector );
+	vector->id = prg->rtd->struct_inbuilt_id;
+	vector->destructor = &colm_vector_destroy;
+	return vector;
+}
+
+/* Takes the reference of a tree value. */
+void colm_vector_push( struct colm_program *prg, vector_t *vector, value_t value )
+{
+	if ( vector->len == vector->alloc ) {
+		vector->alloc = vector->alloc == 0 ? VECTOR_ALLOC_MIN : vector->alloc * 2;
+		vector->data = (value_t*) realloc( vector->data,
+				sizeof(value_t) * vector->alloc );
+	}
+	vector->data[vector->len++] = value;
+}
+
+/* Gives up the reference of a tree value. */
+value_t colm_vector_pop( struct colm_program *prg, vector_t *vector )
+{
+	if ( vector->len == 0 )
+		return 0;
+	return vector->data[--vector->len];
+}
+
+value_t colm_vector_get( struct colm_program *prg, vector_t *vector, long pos )
+{
+	if ( pos < 0 || pos >= vector->len )
+		return 0;
+
+	value_t value = vector->data[pos];
+	if ( vector->generic_info->value_type == TYPE_TREE )
+		colm_tree_upref( prg, (tree_t*)value );
+	return value;
+}
+
+/* Stable, bottom up merge sort. Runs are started with insertion sort. */
+#define VECTOR_SORT_RUN 8
+
+void colm_vector_sort( struct colm_program *prg, vector_t *vector )
+{
+	struct generic_info *gi = vector->generic_info;
+	long len = vector->len, i, j, width;
+
+	if ( len < 2 )
+		return;
+
+	value_t *src = vector->data;
+	for ( i = 0; i < len; i += VECTOR_SORT_RUN ) {
+		long end = i + VECTOR_SORT_RUN < len ? i + VECTOR_SORT_RUN : len;
+		for ( j = i + 1; j < end; j++ ) {
+			value_t v = src[j];
+			long k = j;
+			while ( k > i && colm_key_cmp( prg, gi,
+					(tree_t*)v, (tree_t*)src[k-1] ) < 0 ) {
+				src[k] = src[k-1];
+				k -= 1;
+			}
+			src[k] = v;
+		}
+	}
+
+	if ( len <= VECTOR_SORT_RUN )
+		return;
+
+	value_t *tmp = (value_t*) malloc( sizeof(value_t) * len );
+	value_t *dst = tmp;
+
+	for ( width = VECTOR_SORT_RUN; width < len; width *= 2 ) {
+		for ( i = 0; i < len; i += 2 * width ) {
+			long mid = i + width < len ? i + width : len;
+			long hi = i + 2 * width < len ? i + 2 * width : len;
+			long a = i, b = mid, k = i;
+
+			while ( a < mid && b < hi ) {
+				if ( colm_key_cmp( prg, gi, (tree_t*)src[b], (tree_t*)src[a] ) < 0 )
+					dst[k++] = src[b++];
+				else
+					dst[k++] = src[a++];
+			}
+			while ( a < mid )
+				dst[k++] = src[a++];
+			while ( b < hi )
+				dst[k++] = src[b++];
+		}
+
+		value_t *swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if ( src != vector->data )
+		memcpy( vector->data, src, sizeof(value_t) * len );
+
+	free( tmp );
+}
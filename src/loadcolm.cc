@@ -872,6 +872,17 @@ struct LoadColm
 				keyType, elType, valType );
 	}
 
+	TypeRef *walkValueHashMap( type_ref typeRef )
+	{
+		TypeRef *keyType = walkTypeRef( typeRef.KeyType() );
+		TypeRef *valType = walkTypeRef( typeRef.ValType() );
+		TypeRef *elType = TypeRef::cons( typeRef.loc(),
+				TypeRef::MapEl, 0, keyType, valType );
+
+		return TypeRef::cons( typeRef.loc(), TypeRef::HashMap, 0,
+				keyType, elType, valType );
+	}
+
 	TypeRef *walkMapEl( type_ref typeRef )
 	{
 		TypeRef *keyType = walkTypeRef( typeRef.KeyType() );
@@ -923,6 +934,15 @@ struct LoadColm
 		case type_ref::MapEl: {
 			tr = walkMapEl( typeRef );
 			break;
+		}
+		case type_ref::HashMap: {
+			tr = walkValueHashMap( typeRef );
+			break;
+		}
+		case type_ref::Vector: {
+			TypeRef *type = walkTypeRef( typeRef._type_ref() );
+			tr = TypeRef::cons( typeRef.loc(), TypeRef::Vector, 0, type, 0 );
+			break;
 		}}
 		return tr;
 	}
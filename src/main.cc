@@ -77,6 +77,14 @@ const char *binaryFn = 0;
 const char *exportHeaderFn = 0;
 const char *exportCodeFn = 0;
 const char *commitCodeFn = 0;
+const char *scanProfileGenFn = 0;
+const char *scanProfileUseFn = 0;
+long autoCommit = 0;
+bool iterIndex = false;
+bool treeHash = false;
+bool shareTokens = false;
+bool readAhead = false;
+bool commitPrint = false;
 const char *objectName = "colm_object";
 bool exportCode = false;
 bool hostAdapters = true;
@@ -188,6 +196,14 @@ void usage()
 "   -L <path>            additional library path for the linker\n"
 "   -l                   activate logging\n"
 "   -c                   compile only (don't produce binary)\n"
+"   -p <file>            instrument the scanner, write a profile to <file>\n"
+"   -u <file>            lay out the scanner using the profile in <file>\n"
+"   -C <tokens>          commit the parse every <tokens> tokens when possible\n"
+"   -T                   index trees for repeated typed iteration\n"
+"   -Q                   cache tree hashes to speed up == and !=\n"
+"   -K                   share identical tokens in parse results\n"
+"   -R                   read input pipes ahead on a helper thread\n"
+"   -F                   print committed parts of a parse of stdin right away\n"
 "   -V                   print dot format (graphiz)\n"
 "   -d                   print verbose debug information\n"
 #if DEBUG
@@ -530,7 +546,7 @@ bool inSourceTree( const char *argv0, char *&location )
 
 void processArgs( int argc, const char **argv )
 {
-	ParamCheck pc( "cD:e:x:I:L:vdlio:S:M:vHh?-:sVa:m:b:E:", argc, argv );
+	ParamCheck pc( "cD:e:x:I:L:vdlio:S:M:vHh?-:sVa:m:b:E:p:u:C:TQKRF", argc, argv );
 
 	while ( pc.check() ) {
 		switch ( pc.state ) {
@@ -616,6 +632,32 @@ void processArgs( int argc, const char **argv )
 			case 'm':
 				commitCodeFn = pc.parameterArg;
 				break;
+			case 'p':
+				scanProfileGenFn = pc.parameterArg;
+				break;
+			case 'u':
+				scanProfileUseFn = pc.parameterArg;
+				break;
+			case 'C':
+				autoCommit = strtol( pc.parameterArg, 0, 10 );
+				if ( autoCommit <= 0 )
+					fatal( "-C option argument must be a positive number of tokens" );
+				break;
+			case 'T':
+				iterIndex = true;
+				break;
+			case 'Q':
+				treeHash = true;
+				break;
+			case 'K':
+				shareTokens = true;
+				break;
+			case 'R':
+				readAhead = true;
+				break;
+			case 'F':
+				commitPrint = true;
+				break;
 
 			case 'E': {
 				const char *eq = strchr( pc.parameterArg, '=' );
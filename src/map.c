@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include <colm/pdarun.h>
 #include <colm/pool.h>
@@ -556,26 +557,65 @@ map_el_t *map_copy_branch( program_t *prg, map_t *map, map_el_t *el, kid_t *old_
 }
 #endif
 
-static long map_cmp( program_t *prg, map_t *map, const tree_t *tree1, const tree_t *tree2 )
+/*
+ * Key comparison. The compiler picks the kernel from the key type. The str
+ * and token kernels order keys exactly as colm_cmp_tree does, falling back to
+ * it if a key is not of the declared kind.
+ */
+static long map_cmp_str( program_t *prg, const tree_t *tree1, const tree_t *tree2 )
 {
-	if ( map->generic_info->key_type == TYPE_TREE ) {
+	if ( tree1 == 0 || tree2 == 0 || tree1->id != LEL_ID_STR || tree2->id != LEL_ID_STR )
 		return colm_cmp_tree( prg, tree1, tree2 );
+
+	return cmp_string( ((str_t*)tree1)->value, ((str_t*)tree2)->value );
+}
+
+/* Attributes and ignores do not take part in the comparison and tokens
+ * have no other children, so the text decides. */
+static long map_cmp_token( program_t *prg, const tree_t *tree1, const tree_t *tree2 )
+{
+	if ( tree1 == 0 || tree2 == 0 || tree1->id != tree2->id ||
+			tree1->id >= prg->rtd->first_non_term_id )
+		return colm_cmp_tree( prg, tree1, tree2 );
+
+	if ( tree1->tokdata == 0 || tree2->tokdata == 0 )
+		return ( tree1->tokdata != 0 ) - ( tree2->tokdata != 0 );
+
+	return cmp_string( tree1->tokdata, tree2->tokdata );
+}
+
+long colm_key_cmp( program_t *prg, struct generic_info *gi,
+		const tree_t *tree1, const tree_t *tree2 )
+{
+	switch ( gi->key_cmp ) {
+		case KEY_CMP_INT:
+			return ( (long)tree1 > (long)tree2 ) - ( (long)tree1 < (long)tree2 );
+		case KEY_CMP_PTR:
+			return ( (unsigned long)tree1 > (unsigned long)tree2 ) -
+					( (unsigned long)tree1 < (unsigned long)tree2 );
+		case KEY_CMP_STR:
+			return map_cmp_str( prg, tree1, tree2 );
+		case KEY_CMP_TOKEN:
+			return map_cmp_token( prg, tree1, tree2 );
+		default:
+			return colm_cmp_tree( prg, tree1, tree2 );
 	}
-	else {
-		if ( (long)tree1 < (long)tree2 )
-			return -1;
-		else if ( (long)tree1 > (long)tree2)
-			return 1;
-		return 0;
-	}
+}
+
+static long map_cmp( program_t *prg, map_t *map, const tree_t *tree1, const tree_t *tree2 )
+{
+	return colm_key_cmp( prg, map->generic_info, tree1, tree2 );
 }
 
 map_el_t *map_insert_el( program_t *prg, map_t *map, map_el_t *element, map_el_t **last_found )
 {
 	long key_relation;
-	map_el_t *cur_el = map->root, *parent_el = 0;
+	map_el_t *cur_el, *parent_el = 0;
 	map_el_t *last_less = 0;
 
+	map_settle( map );
+	cur_el = map->root;
+
 	while ( true ) {
 		if ( cur_el == 0 ) {
 			/* We are at an external element and did not find the key we were
@@ -710,9 +750,12 @@ map_el_t *colm_map_find( program_t *prg, map_t *map, tree_t *key )
  */
 map_el_t *map_impl_find( program_t *prg, map_t *map, tree_t *key )
 {
-	map_el_t *cur_el = map->root;
+	map_el_t *cur_el;
 	long key_relation;
 
+	map_settle( map );
+	cur_el = map->root;
+
 	while ( cur_el != 0 ) {
 		key_relation = map_cmp( prg, map, key, cur_el->key );
 
@@ -759,6 +802,8 @@ map_el_t *map_detach( program_t *prg, map_t *map, map_el_t *element )
 	map_el_t *replacement, *fixfrom;
 	long lheight, rheight;
 
+	map_settle( map );
+
 	/* Remove the element from the ordered list. */
 	map_list_detach( map, element );
 
@@ -874,3 +919,465 @@ map_el_t *map_detach( program_t *prg, map_t *map, map_el_t *element )
 
 
 
+/*
+ * Bulk operations. These work on the ordered list and then link the whole
+ * tree in one pass, which is linear, instead of paying for a search and a
+ * rebalance per element.
+ */
+
+/* Builds a perfectly balanced subtree from the next n elements of the list,
+ * starting at *cur. Both halves differ in size by at most one, so the result
+ * is a valid AVL tree. */
+static map_el_t *map_build_balanced( map_el_t **cur, long n )
+{
+	if ( n == 0 )
+		return 0;
+
+	map_el_t *left = map_build_balanced( cur, n / 2 );
+	map_el_t *root = *cur;
+	*cur = root->next;
+	map_el_t *right = map_build_balanced( cur, n - n / 2 - 1 );
+
+	root->left = left;
+	root->right = right;
+	if ( left != 0 )
+		left->parent = root;
+	if ( right != 0 )
+		right->parent = root;
+
+	long lheight = left ? left->height : 0;
+	long rheight = right ? right->height : 0;
+	root->height = (lheight > rheight ? lheight : rheight) + 1;
+
+	return root;
+}
+
+/* Relinks the tree from the ordered list. */
+void map_rebuild( map_t *map )
+{
+	map_el_t *cur = map->head;
+	map->root = map_build_balanced( &cur, map->tree_size );
+	if ( map->root != 0 )
+		map->root->parent = 0;
+	map->pending = 0;
+}
+
+/* Links elements left by colm_map_append into the tree. A short run goes
+ * in one at a time down the right edge, otherwise the tree is rebuilt. */
+void map_settle( map_t *map )
+{
+	if ( map->pending == 0 )
+		return;
+
+	long linked = map->tree_size - map->pending;
+	if ( map->pending * 4 >= linked ) {
+		map_rebuild( map );
+		return;
+	}
+
+	/* Cut the pending run off the list. The tail is then the rightmost
+	 * element of the tree. */
+	map_el_t *el = map->tail;
+	long i;
+	for ( i = 1; i < map->pending; i++ )
+		el = el->prev;
+
+	map->tail = el->prev;
+	map->tail->next = 0;
+	map->tree_size = linked;
+	map->pending = 0;
+
+	while ( el != 0 ) {
+		map_el_t *next = el->next;
+		map_attach_rebal( map, el, map->tail, 0 );
+		el = next;
+	}
+}
+
+/* Appends an element whose key is greater than every key in the map. The
+ * tree is linked lazily, so loading a map from sorted input is linear.
+ * Returns zero, leaving the map unchanged, if the key is out of order. */
+map_el_t *colm_map_append( program_t *prg, map_t *map, map_el_t *map_el )
+{
+	if ( map->tail != 0 && map_cmp( prg, map, map_el->key, map->tail->key ) <= 0 )
+		return 0;
+
+	map_el->left = map_el->right = map_el->parent = 0;
+	map_el->height = 1;
+
+	map_list_add_after( map, map->tail, map_el );
+	map->tree_size += 1;
+	map->pending += 1;
+	return map_el;
+}
+
+map_el_t *colm_vmap_append( program_t *prg, tree_t **sp, map_t *map,
+		struct_t *key, struct_t *value )
+{
+	struct generic_info *gi = map->generic_info;
+
+	/* Check before allocating an element. The arguments are owned here. */
+	if ( map->tail != 0 && map_cmp( prg, map, (tree_t*)key, map->tail->key ) <= 0 ) {
+		if ( gi->key_type == TYPE_TREE )
+			colm_tree_downref( prg, sp, (tree_t*)key );
+		if ( gi->value_type == TYPE_TREE )
+			colm_tree_downref( prg, sp, (tree_t*)value );
+		return 0;
+	}
+
+	struct colm_struct *s = colm_struct_new( prg, gi->el_struct_id );
+
+	colm_struct_set_field( s, struct_t*, gi->el_offset, key );
+	colm_struct_set_field( s, struct_t*, 0, value );
+
+	map_el_t *map_el = colm_struct_get_addr( s, map_el_t*, gi->el_offset );
+
+	return colm_map_append( prg, map, map_el );
+}
+
+/* New element holding the key and value of an element of another map of the
+ * same type. */
+static map_el_t *map_copy_el( program_t *prg, map_t *map, map_el_t *src )
+{
+	struct generic_info *gi = map->generic_info;
+	long gen_id = gi - prg->rtd->generic_info;
+
+	struct_t *src_s = colm_generic_el_container( prg, src, gen_id );
+	tree_t *value = colm_struct_get_field( src_s, tree_t*, 0 );
+
+	if ( gi->key_type == TYPE_TREE )
+		colm_tree_upref( prg, src->key );
+	if ( gi->value_type == TYPE_TREE )
+		colm_tree_upref( prg, value );
+
+	struct colm_struct *s = colm_struct_new( prg, gi->el_struct_id );
+
+	colm_struct_set_field( s, tree_t*, gi->el_offset, src->key );
+	colm_struct_set_field( s, tree_t*, 0, value );
+
+	return colm_struct_get_addr( s, map_el_t*, gi->el_offset );
+}
+
+/* Adds copies of the elements of other whose keys are not in map. Both lists
+ * are sorted, so this is a linear merge. If added is given it receives an
+ * array of the new elements, which the caller frees. Returns the number of
+ * elements added. */
+long colm_map_union( program_t *prg, map_t *map, map_t *other, map_el_t ***added )
+{
+	map_el_t **els = 0;
+	long n = 0;
+
+	if ( added != 0 && other->tree_size > 0 )
+		els = (map_el_t**) malloc( sizeof(map_el_t*) * other->tree_size );
+
+	map_el_t *a = map->head, *b = other->head;
+	while ( b != 0 ) {
+		long relation = a != 0 ? map_cmp( prg, map, a->key, b->key ) : 1;
+		if ( relation < 0 ) {
+			a = a->next;
+		}
+		else {
+			if ( relation > 0 ) {
+				map_el_t *el = map_copy_el( prg, map, b );
+				map_list_add_before( map, a, el );
+				map->tree_size += 1;
+				if ( els != 0 )
+					els[n] = el;
+				n += 1;
+			}
+			else {
+				a = a->next;
+			}
+			b = b->next;
+		}
+	}
+
+	if ( n > 0 )
+		map_rebuild( map );
+
+	if ( added != 0 ) {
+		if ( n == 0 ) {
+			free( els );
+			els = 0;
+		}
+		*added = els;
+	}
+	return n;
+}
+
+/* Detaches the elements of map whose keys are not in other. The detached
+ * elements are not freed. If removed is given it receives an array of them,
+ * in order, which the caller frees. Returns the number detached. */
+long colm_map_intersect( program_t *prg, map_t *map, map_t *other, map_el_t ***removed )
+{
+	map_el_t **els = 0;
+	long n = 0;
+
+	if ( removed != 0 && map->tree_size > 0 )
+		els = (map_el_t**) malloc( sizeof(map_el_t*) * map->tree_size );
+
+	map_el_t *a = map->head, *b = other->head;
+	while ( a != 0 ) {
+		long relation = b != 0 ? map_cmp( prg, map, a->key, b->key ) : -1;
+		if ( relation > 0 ) {
+			b = b->next;
+		}
+		else {
+			map_el_t *next = a->next;
+			if ( relation < 0 ) {
+				map_list_detach( map, a );
+				map->tree_size -= 1;
+				if ( els != 0 )
+					els[n] = a;
+				n += 1;
+			}
+			else {
+				b = b->next;
+			}
+			a = next;
+		}
+	}
+
+	if ( n > 0 )
+		map_rebuild( map );
+
+	if ( removed != 0 ) {
+		if ( n == 0 ) {
+			free( els );
+			els = 0;
+		}
+		*removed = els;
+	}
+	return n;
+}
+
+/* Reverts a union by detaching the elements it added. */
+void colm_map_unmerge( map_t *map, map_el_t **els, long n )
+{
+	long i;
+	for ( i = 0; i < n; i++ ) {
+		map_list_detach( map, els[i] );
+		map->tree_size -= 1;
+	}
+	map_rebuild( map );
+}
+
+/* Reverts an intersect by merging the sorted detached elements back in. */
+void colm_map_remerge( program_t *prg, map_t *map, map_el_t **els, long n )
+{
+	map_el_t *a = map->head;
+	long i;
+	for ( i = 0; i < n; i++ ) {
+		while ( a != 0 && map_cmp( prg, map, a->key, els[i]->key ) < 0 )
+			a = a->next;
+		map_list_add_before( map, a, els[i] );
+		map->tree_size += 1;
+	}
+	map_rebuild( map );
+}
+
+/* First element with a key not less than the given key, or zero. Walking
+ * next from it visits the range in order. */
+map_el_t *colm_map_lower_bound( program_t *prg, map_t *map, tree_t *key )
+{
+	map_el_t *cur_el, *result = 0;
+
+	map_settle( map );
+	cur_el = map->root;
+
+	while ( cur_el != 0 ) {
+		long key_relation = map_cmp( prg, map, key, cur_el->key );
+		if ( key_relation <= 0 ) {
+			result = cur_el;
+			if ( key_relation == 0 )
+				break;
+			cur_el = cur_el->left;
+		}
+		else {
+			cur_el = cur_el->right;
+		}
+	}
+	return result;
+}
+
+
+
+/*
+ * Hashmap. Shares the map element and the ordered list with the AVL map, so
+ * iteration, length and the head/tail fields work unchanged, and iterates in
+ * insertion order. Elements are found through an open addressing table with
+ * linear probing. The tree links of the element are unused and the height
+ * holds the key's hash.
+ */
+#define HMAP_TABLE_MIN 16
+
+static unsigned long hmap_hash( program_t *prg, map_t *map, tree_t *key )
+{
+	if ( map->generic_info->key_type == TYPE_TREE ) {
+		/* Cached in the tree. A str key is a single node, so this is a
+		 * hash of its bytes. */
+		return colm_tree_hash( prg, key );
+	}
+	else {
+		unsigned long v = (unsigned long)key * 0x9e3779b97f4a7c15ul;
+		return (unsigned int)( v ^ ( v >> 32 ) );
+	}
+}
+
+static int hmap_eql( program_t *prg, map_t *map, tree_t *key1, tree_t *key2 )
+{
+	if ( key1 == key2 )
+		return true;
+	if ( map->generic_info->key_type == TYPE_TREE )
+		return map_cmp( prg, map, key1, key2 ) == 0;
+	return false;
+}
+
+static long hmap_probe( program_t *prg, map_t *map, tree_t *key, unsigned long hash )
+{
+	long mask = map->table_len - 1;
+	long i = hash & mask;
+	while ( map->table[i] != 0 ) {
+		map_el_t *el = map->table[i];
+		if ( (unsigned long)el->height == hash && hmap_eql( prg, map, key, el->key ) )
+			break;
+		i = ( i + 1 ) & mask;
+	}
+	return i;
+}
+
+static void hmap_resize( map_t *map, long table_len )
+{
+	map_el_t **table = (map_el_t**) calloc( table_len, sizeof(map_el_t*) );
+	long mask = table_len - 1;
+
+	/* Stored hashes make this a plain reinsert, keys are not looked at. */
+	map_el_t *el;
+	for ( el = map->head; el != 0; el = el->next ) {
+		long i = (unsigned long)el->height & mask;
+		while ( table[i] != 0 )
+			i = ( i + 1 ) & mask;
+		table[i] = el;
+	}
+
+	free( map->table );
+	map->table = table;
+	map->table_len = table_len;
+}
+
+void colm_hashmap_destroy( program_t *prg, tree_t **sp, struct colm_struct *s )
+{
+	map_t *map = (map_t*) s;
+	free( map->table );
+}
+
+map_el_t *colm_hmap_find_el( program_t *prg, map_t *map, tree_t *key )
+{
+	if ( map->tree_size == 0 )
+		return 0;
+
+	unsigned long hash = hmap_hash( prg, map, key );
+	return map->table[hmap_probe( prg, map, key, hash )];
+}
+
+/* Returns the element if inserted, zero if the key is present. */
+map_el_t *colm_hmap_insert_el( program_t *prg, map_t *map, map_el_t *map_el )
+{
+	/* Keep the load at one half or below. */
+	if ( ( map->tree_size + 1 ) * 2 > map->table_len ) {
+		hmap_resize( map, map->table_len == 0 ?
+				HMAP_TABLE_MIN : map->table_len * 2 );
+	}
+
+	unsigned long hash = hmap_hash( prg, map, map_el->key );
+	long i = hmap_probe( prg, map, map_el->key, hash );
+	if ( map->table[i] != 0 )
+		return 0;
+
+	map_el->height = hash;
+	map_el->left = map_el->right = map_el->parent = 0;
+	map->table[i] = map_el;
+
+	map_list_add_after( map, map->tail, map_el );
+	map->tree_size++;
+	return map_el;
+}
+
+void colm_hmap_detach( program_t *prg, map_t *map, map_el_t *map_el )
+{
+	long mask = map->table_len - 1;
+	long i = (unsigned long)map_el->height & mask;
+	while ( map->table[i] != map_el )
+		i = ( i + 1 ) & mask;
+
+	/* Backward shift deletion. Move up any element after the hole that
+	 * would no longer be reachable from its home slot. */
+	long j = i;
+	map->table[i] = 0;
+	while ( true ) {
+		j = ( j + 1 ) & mask;
+		if ( map->table[j] == 0 )
+			break;
+
+		long home = (unsigned long)map->table[j]->height & mask;
+		int reachable = i <= j ?
+				( i < home && home <= j ) :
+				( i < home || home <= j );
+		if ( !reachable ) {
+			map->table[i] = map->table[j];
+			map->table[j] = 0;
+			i = j;
+		}
+	}
+
+	map_list_detach( map, map_el );
+	map->tree_size--;
+}
+
+map_el_t *colm_hmap_insert( program_t *prg, tree_t **sp, map_t *map,
+		struct_t *key, struct_t *value )
+{
+	struct generic_info *gi = map->generic_info;
+
+	/* Check before allocating an element. The arguments are owned here. */
+	if ( colm_hmap_find_el( prg, map, (tree_t*)key ) != 0 ) {
+		if ( gi->key_type == TYPE_TREE )
+			colm_tree_downref( prg, sp, (tree_t*)key );
+		if ( gi->value_type == TYPE_TREE )
+			colm_tree_downref( prg, sp, (tree_t*)value );
+		return 0;
+	}
+
+	struct colm_struct *s = colm_struct_new( prg, gi->el_struct_id );
+
+	colm_struct_set_field( s, struct_t*, gi->el_offset, key );
+	colm_struct_set_field( s, struct_t*, 0, value );
+
+	map_el_t *map_el = colm_struct_get_addr( s, map_el_t*, gi->el_offset );
+
+	return colm_hmap_insert_el( prg, map, map_el );
+}
+
+map_el_t *colm_hmap_remove( program_t *prg, map_t *map, tree_t *key )
+{
+	map_el_t *map_el = colm_hmap_find_el( prg, map, key );
+	if ( map_el != 0 )
+		colm_hmap_detach( prg, map, map_el );
+	return map_el;
+}
+
+tree_t *colm_hmap_find( program_t *prg, map_t *map, tree_t *key )
+{
+	map_el_t *map_el = colm_hmap_find_el( prg, map, key );
+	if ( map_el != 0 ) {
+		struct_t *s = colm_generic_el_container( prg, map_el,
+				map->generic_info - prg->rtd->generic_info );
+		tree_t *val = colm_struct_get_field( s, tree_t*, 0 );
+
+		if ( map->generic_info->value_type == TYPE_TREE )
+			colm_tree_upref( prg, val );
+
+		return val;
+	}
+	return 0;
+}
@@ -51,12 +51,16 @@ map_el_t *map_insert_key( program_t *prg, map_t *map, tree_t *key, map_el_t **la
 map_el_t *map_impl_find( program_t *prg, map_t *map, tree_t *key );
 map_el_t *map_detach_by_key( program_t *prg, map_t *map, tree_t *key );
 map_el_t *map_detach( program_t *prg, map_t *map, map_el_t *element );
+void map_rebuild( map_t *map );
+void map_settle( map_t *map );
 map_el_t *map_copy_branch( program_t *prg, map_t *map, map_el_t *el,
 		kid_t *old_next_down, kid_t **new_next_down );
 
 struct tree_pair map_remove( program_t *prg, map_t *map, tree_t *key );
 
 long cmp_tree( program_t *prg, const tree_t *tree1, const tree_t *tree2 );
+long colm_key_cmp( program_t *prg, struct generic_info *gi,
+		const tree_t *tree1, const tree_t *tree2 );
 
 void map_impl_remove_el( program_t *prg, map_t *map, map_el_t *element );
 int map_impl_remove_key( program_t *prg, map_t *map, tree_t *key );
@@ -78,6 +82,24 @@ map_el_t *colm_vmap_remove( program_t *prg, map_t *map, tree_t *key );
 tree_t *colm_map_iter_advance( program_t *prg, tree_t ***psp, generic_iter_t *iter );
 tree_t *colm_vmap_find( program_t *prg, map_t *map, tree_t *key );
 
+map_el_t *colm_map_append( program_t *prg, map_t *map, map_el_t *map_el );
+map_el_t *colm_vmap_append( program_t *prg, tree_t **sp, map_t *map,
+		struct_t *key, struct_t *value );
+long colm_map_union( program_t *prg, map_t *map, map_t *other, map_el_t ***added );
+long colm_map_intersect( program_t *prg, map_t *map, map_t *other, map_el_t ***removed );
+void colm_map_unmerge( map_t *map, map_el_t **els, long n );
+void colm_map_remerge( program_t *prg, map_t *map, map_el_t **els, long n );
+map_el_t *colm_map_lower_bound( program_t *prg, map_t *map, tree_t *key );
+
+void colm_hashmap_destroy( program_t *prg, tree_t **sp, struct colm_struct *s );
+map_el_t *colm_hmap_find_el( program_t *prg, map_t *map, tree_t *key );
+map_el_t *colm_hmap_insert_el( program_t *prg, map_t *map, map_el_t *map_el );
+void colm_hmap_detach( program_t *prg, map_t *map, map_el_t *map_el );
+map_el_t *colm_hmap_insert( program_t *prg, tree_t **sp, map_t *map,
+		struct_t *key, struct_t *value );
+map_el_t *colm_hmap_remove( program_t *prg, map_t *map, tree_t *key );
+tree_t *colm_hmap_find( program_t *prg, map_t *map, tree_t *key );
+
 #if defined(__cplusplus)
 }
 #endif
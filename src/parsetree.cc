@@ -172,11 +172,13 @@ int CmpUniqueGeneric::compare( const UniqueGeneric &ut1, const UniqueGeneric &ut
 		switch ( ut1.type ) {
 		case UniqueGeneric::List:
 		case UniqueGeneric::ListEl:
+		case UniqueGeneric::Vector:
 		case UniqueGeneric::Parser:
 			break;
 
 		case UniqueGeneric::Map:
 		case UniqueGeneric::MapEl:
+		case UniqueGeneric::HashMap:
 			if ( ut1.key < ut2.key )
 				return -1;
 			else if ( ut1.key > ut2.key )
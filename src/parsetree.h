@@ -2144,6 +2144,8 @@ struct UniqueGeneric
 		ListEl,
 		Map,
 		MapEl,
+		HashMap,
+		Vector,
 		Parser
 	};
 
@@ -2204,6 +2206,8 @@ struct TypeRef
 		Map,
 		MapEl,
 		MapPtrs,
+		HashMap,
+		Vector,
 		Parser,
 		Ref
 	};
@@ -2392,6 +2396,7 @@ struct TypeRef
 	UniqueType *resolveTypeMap( Compiler *pd );
 	UniqueType *resolveTypeMapEl( Compiler *pd );
 	UniqueType *resolveTypeParser( Compiler *pd );
+	UniqueType *resolveTypeVector( Compiler *pd );
 	UniqueType *resolveType( Compiler *pd );
 	UniqueType *resolveTypeRef( Compiler *pd );
 
@@ -119,7 +119,8 @@ LangEl::LangEl( Namespace *nspace, const String &name, Type type )
 	contextIn(0), 
 	noPreIgnore(false),
 	noPostIgnore(false),
-	isZero(false)
+	isZero(false),
+	unknownContents(false)
 {
 }
  
@@ -1331,6 +1332,101 @@ short *Compiler::makeTrees( ObjectDef *objectDef, int &numTrees )
 }
 
 
+/* For each nonterminal, the set of language elements that the grammar allows
+ * anywhere below it. Iterators and searches use it to skip subtrees that
+ * cannot contain what they look for. */
+void Compiler::makeContainsSets( struct colm_sections *runtimeData )
+{
+	long count = runtimeData->num_lang_els;
+	long len = ( count + 7 ) / 8;
+
+	unsigned char **contains = new unsigned char*[count];
+	bool *unknown = new bool[count];
+
+	for ( long i = 0; i < count; i++ ) {
+		LangEl *lel = langElIndex[i];
+		contains[i] = 0;
+		unknown[i] = lel != 0 && lel->unknownContents;
+		if ( lel != 0 && lel->type == LangEl::NonTerm ) {
+			contains[i] = new unsigned char[len];
+			memset( contains[i], 0, len );
+		}
+	}
+
+	/* Direct children, from the productions. */
+	for ( LelList::Iter lel = langEls; lel.lte(); lel++ ) {
+		if ( contains[lel->id] == 0 )
+			continue;
+
+		for ( LelDefList::Iter def = lel->defList; def.lte(); def++ ) {
+			for ( ProdElList::Iter el = *def->prodElList; el.lte(); el++ ) {
+				if ( el->langEl == 0 ) {
+					unknown[lel->id] = true;
+					continue;
+				}
+
+				long id = el->langEl->id;
+				contains[lel->id][id >> 3] |= 1 << ( id & 7 );
+
+				/* Anything can be in the place of this child. */
+				if ( unknown[id] )
+					unknown[lel->id] = true;
+			}
+		}
+	}
+
+	/* Transitive closure. */
+	for ( long k = 0; k < count; k++ ) {
+		if ( contains[k] == 0 )
+			continue;
+
+		for ( long i = 0; i < count; i++ ) {
+			if ( contains[i] != 0 && contains[i][k >> 3] & ( 1 << ( k & 7 ) ) ) {
+				for ( long b = 0; b < len; b++ )
+					contains[i][b] |= contains[k][b];
+				if ( unknown[k] )
+					unknown[i] = true;
+			}
+		}
+	}
+
+	for ( long i = 0; i < count; i++ ) {
+		if ( unknown[i] ) {
+			delete[] contains[i];
+			contains[i] = 0;
+		}
+		runtimeData->lel_info[i].contains = contains[i];
+	}
+
+	delete[] contains;
+	delete[] unknown;
+}
+
+/* Map key comparison for the declared key type. Strings and tokens compare
+ * only their text, other trees need the general tree compare. */
+enum KEY_CMP Compiler::keyCmp( UniqueType *keyUt )
+{
+	if ( keyUt == 0 )
+		return KEY_CMP_TREE;
+
+	switch ( keyUt->typeId ) {
+		case TYPE_INT:
+		case TYPE_BOOL:
+			return KEY_CMP_INT;
+		case TYPE_TREE:
+			if ( keyUt->langEl == strLangEl )
+				return KEY_CMP_STR;
+			if ( keyUt->langEl->type == LangEl::Term &&
+					keyUt->langEl != ptrLangEl &&
+					keyUt->langEl != ignoreLangEl &&
+					keyUt->langEl != noTokenLangEl )
+				return KEY_CMP_TOKEN;
+			return KEY_CMP_TREE;
+		default:
+			return KEY_CMP_PTR;
+	}
+}
+
 void Compiler::makeRuntimeData()
 {
 	long count = 0;
@@ -1509,6 +1605,8 @@ void Compiler::makeRuntimeData()
 		}
 	}
 
+	makeContainsSets( runtimeData );
+
 	/*
 	 * struct_el_info
 	 */
@@ -1598,7 +1696,8 @@ void Compiler::makeRuntimeData()
 			runtimeData->generic_info[gen->id].type = gen->typeId;
 
 			runtimeData->generic_info[gen->id].el_struct_id =
-					( gen->typeId == GEN_MAP || gen->typeId == GEN_LIST ) ?
+					( gen->typeId == GEN_MAP || gen->typeId == GEN_HASHMAP ||
+					gen->typeId == GEN_LIST ) ?
 					gen->elUt->structEl->id : -1;
 			runtimeData->generic_info[gen->id].el_offset =
 					gen->el != 0 ? gen->el->offset : -1;
@@ -1606,6 +1705,8 @@ void Compiler::makeRuntimeData()
 			runtimeData->generic_info[gen->id].key_type =
 					gen->keyUt != 0 ? gen->keyUt->typeId : TYPE_NOTYPE;
 			runtimeData->generic_info[gen->id].key_offset = 0;
+			runtimeData->generic_info[gen->id].key_cmp = keyCmp(
+					gen->typeId == GEN_VECTOR ? gen->valueUt : gen->keyUt );
 
 			runtimeData->generic_info[gen->id].value_type =
 					gen->valueUt != 0 ? gen->valueUt->typeId : TYPE_NOTYPE;
@@ -1920,12 +2021,15 @@ void Compiler::fillInPatterns( program_t *prg )
 }
 
 
-int Compiler::findIndexOff( struct pda_tables *pdaTables, PdaGraph *pdaGraph, PdaState *state, int &curLen )
+/* The first transition of the state lands on start, so there is no point
+ * trying anything below the first free slot. */
+int Compiler::findIndexOff( struct pda_ind *indicies, PdaGraph *pdaGraph,
+		PdaState *state, int firstFree, int &curLen )
 {
-	for ( int start = 0; start < curLen;  ) {
+	for ( int start = firstFree; start < curLen;  ) {
 		int offset = start;
 		for ( TransMap::Iter trans = state->transMap; trans.lte(); trans++ ) {
-			if ( pdaTables->owners[offset] != -1 )
+			if ( indicies[offset].owner != -1 )
 				goto next_start;
 
 			offset++;
@@ -1986,6 +2090,69 @@ PdaGraph *Compiler::makePdaGraph( LangElSet &parserEls )
 	return pdaGraph;
 }
 
+/* Copies a table into the narrowest type that holds all of its values. */
+static const void *narrowTable( const int *vals, long len, int &width )
+{
+	int min = 0, max = 0;
+	for ( long i = 0; i < len; i++ ) {
+		if ( vals[i] < min )
+			min = vals[i];
+		if ( vals[i] > max )
+			max = vals[i];
+	}
+
+	if ( min >= SCHAR_MIN && max <= SCHAR_MAX ) {
+		signed char *table = new signed char[len];
+		for ( long i = 0; i < len; i++ )
+			table[i] = vals[i];
+		width = sizeof(signed char);
+		return table;
+	}
+	else if ( min >= SHRT_MIN && max <= SHRT_MAX ) {
+		short *table = new short[len];
+		for ( long i = 0; i < len; i++ )
+			table[i] = vals[i];
+		width = sizeof(short);
+		return table;
+	}
+	else {
+		int *table = new int[len];
+		memcpy( table, vals, sizeof(int) * len );
+		width = sizeof(int);
+		return table;
+	}
+}
+
+static const void *narrowTable( const unsigned int *vals, long len, int &width )
+{
+	unsigned int max = 0;
+	for ( long i = 0; i < len; i++ ) {
+		if ( vals[i] > max )
+			max = vals[i];
+	}
+
+	if ( max <= UCHAR_MAX ) {
+		unsigned char *table = new unsigned char[len];
+		for ( long i = 0; i < len; i++ )
+			table[i] = vals[i];
+		width = sizeof(unsigned char);
+		return table;
+	}
+	else if ( max <= USHRT_MAX ) {
+		unsigned short *table = new unsigned short[len];
+		for ( long i = 0; i < len; i++ )
+			table[i] = vals[i];
+		width = sizeof(unsigned short);
+		return table;
+	}
+	else {
+		unsigned int *table = new unsigned int[len];
+		memcpy( table, vals, sizeof(unsigned int) * len );
+		width = sizeof(unsigned int);
+		return table;
+	}
+}
+
 struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 {
 	int count, pos;
@@ -2006,41 +2173,39 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 	}
 
 
-	/* Allocate indicies and owners. */
-	pdaTables->num_indicies = count;
-	pdaTables->indicies = new int[count];
-	pdaTables->owners = new int[count];
+	/* Allocate indicies. */
+	struct pda_ind *indicies = new pda_ind[count];
 	for ( long i = 0; i < count; i++ ) {
-		pdaTables->indicies[i] = -1;
-		pdaTables->owners[i] = -1;
+		indicies[i].owner = -1;
+		indicies[i].index = -1;
 	}
 
 	/* Allocate offsets. */
 	int numStates = pdaGraph->stateList.length(); 
-	pdaTables->offsets = new unsigned int[numStates];
+	unsigned int *offsets = new unsigned int[numStates];
 	pdaTables->num_states = numStates;
 
-	/* Place transitions into indicies/owners */
+	/* Place transitions into indicies. */
 	PdaState **states = new PdaState*[numStates];
 	long ds = 0;
 	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ )
 		states[ds++] = state;
 
-	/* Sorting baseded on span length. Gives an improvement, but incures a
-	 * cost. Off for now. */
-	//MergeSort< PdaState*, CmpSpan > mergeSort;
-	//mergeSort.sort( states, numStates );
+	/* Sorting baseded on span length, widest first. Starting the search at
+	 * the first free slot keeps the cost of this down. */
+	MergeSort< PdaState*, CmpSpan > mergeSort;
+	mergeSort.sort( states, numStates );
 	
-	int indLen = 0;
+	int indLen = 0, firstFree = 0;
 	for ( int s = 0; s < numStates; s++ ) {
 		PdaState *state = states[s];
 
-		int indOff = findIndexOff( pdaTables, pdaGraph, state, indLen );
-		pdaTables->offsets[state->stateNum] = indOff;
+		int indOff = findIndexOff( indicies, pdaGraph, state, firstFree, indLen );
+		offsets[state->stateNum] = indOff;
 
 		for ( TransMap::Iter trans = state->transMap; trans.lte(); trans++ ) {
-			pdaTables->indicies[indOff] = trans->value->actionSetEl->key.id;
-			pdaTables->owners[indOff] = state->stateNum;
+			indicies[indOff].index = trans->value->actionSetEl->key.id;
+			indicies[indOff].owner = state->stateNum;
 			indOff++;
 
 			if ( ! trans.last() ) {
@@ -2051,10 +2216,27 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 
 		if ( indOff > indLen )
 			indLen = indOff;
+
+		while ( firstFree < indLen && indicies[firstFree].owner != -1 )
+			firstFree += 1;
+	}
+
+	/* We allocated the max, but cmpression gives us less. The pairs are
+	 * stored flat, owner first. */
+	int *pairs = new int[indLen * 2];
+	for ( int i = 0; i < indLen; i++ ) {
+		pairs[i * 2] = indicies[i].owner;
+		pairs[i * 2 + 1] = indicies[i].index;
 	}
 
-	/* We allocated the max, but cmpression gives us less. */
 	pdaTables->num_indicies = indLen;
+	pdaTables->indicies = narrowTable( pairs, indLen * 2,
+			pdaTables->indicies_width );
+	pdaTables->offsets = narrowTable( offsets, numStates,
+			pdaTables->offsets_width );
+	delete[] pairs;
+	delete[] indicies;
+	delete[] offsets;
 	delete[] states;
 	
 
@@ -2062,48 +2244,57 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 	 * Keys
 	 */
 	count = pdaGraph->stateList.length() * 2;;
-	pdaTables->keys = new int[count];
+	int *keys = new int[count];
 	pdaTables->num_keys = count;
 
 	count = 0;
 	for ( PdaStateList::Iter state = pdaGraph->stateList; state.lte(); state++ ) {
 		if ( state->transMap.length() == 0 ) {
-			pdaTables->keys[count+0] = 0;
-			pdaTables->keys[count+1] = 0;
+			keys[count+0] = 0;
+			keys[count+1] = 0;
 		}
 		else {
 			TransMap::Iter first = state->transMap.first();
 			TransMap::Iter last = state->transMap.last();
-			pdaTables->keys[count+0] = first->key;
-			pdaTables->keys[count+1] = last->key;
+			keys[count+0] = first->key;
+			keys[count+1] = last->key;
 		}
 		count += 2;
 	}
 
+	pdaTables->keys = narrowTable( keys, count, pdaTables->keys_width );
+	delete[] keys;
+
 	/*
 	 * Targs
 	 */
 	count = pdaGraph->actionSet.length();
-	pdaTables->targs = new unsigned int[count];
+	unsigned int *targs = new unsigned int[count];
 	pdaTables->num_targs = count;
 
 	count = 0;
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ )
-		pdaTables->targs[count++] = asi->key.targ;
+		targs[count++] = asi->key.targ;
+
+	pdaTables->targs = narrowTable( targs, count, pdaTables->targs_width );
+	delete[] targs;
 
 	/* 
 	 * ActInds
 	 */
 	count = pdaGraph->actionSet.length();
-	pdaTables->act_inds = new unsigned int[count];
+	unsigned int *actInds = new unsigned int[count];
 	pdaTables->num_act_inds = count;
 
 	count = pos = 0;
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ ) {
-		pdaTables->act_inds[count++] = pos;
+		actInds[count++] = pos;
 		pos += asi->key.actions.length() + 1;
 	}
 
+	pdaTables->act_inds = narrowTable( actInds, count, pdaTables->act_inds_width );
+	delete[] actInds;
+
 	/*
 	 * Actions
 	 */
@@ -2111,27 +2302,34 @@ struct pda_tables *Compiler::makePdaTables( PdaGraph *pdaGraph )
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ )
 		count += asi->key.actions.length() + 1;
 
-	pdaTables->actions = new unsigned int[count];
+	unsigned int *actions = new unsigned int[count];
 	pdaTables->num_actions = count;
 
 	count = 0;
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ ) {
 		for ( ActDataList::Iter ali = asi->key.actions; ali.lte(); ali++ )
-			pdaTables->actions[count++] = *ali;
+			actions[count++] = *ali;
 
-		pdaTables->actions[count++] = 0;
+		actions[count++] = 0;
 	}
 
+	pdaTables->actions = narrowTable( actions, count, pdaTables->actions_width );
+	delete[] actions;
+
 	/*
 	 * CommitLen
 	 */
 	count = pdaGraph->actionSet.length();
-	pdaTables->commit_len = new int[count];
+	int *commitLen = new int[count];
 	pdaTables->num_commit_len = count;
 
 	count = 0;
 	for ( PdaActionSet::Iter asi = pdaGraph->actionSet; asi.lte(); asi++ )
-		pdaTables->commit_len[count++] = asi->key.commitLen;
+		commitLen[count++] = asi->key.commitLen;
+
+	pdaTables->commit_len = narrowTable( commitLen, count,
+			pdaTables->commit_len_width );
+	delete[] commitLen;
 	
 	/*
 	 * tokenRegionInds. Start at one so region index 0 is null (unset).
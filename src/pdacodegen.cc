@@ -159,6 +159,28 @@ void PdaCodeGen::writeRuntimeData( colm_sections *runtimeData, struct pda_tables
 	}
 	out << "\n};\n\n";
 
+	/*
+	 * Sets of contained language elements.
+	 */
+	long containsLen = ( runtimeData->num_lang_els + 7 ) / 8;
+	for ( int i = 0; i < runtimeData->num_lang_els; i++ ) {
+		const unsigned char *block = runtimeData->lel_info[i].contains;
+		if ( block != 0 ) {
+			out << "static const unsigned char contains_" << i << "[] = {\n\t";
+
+			for ( int j = 0; j < containsLen; j++ ) {
+				out << (unsigned int) block[j];
+
+				if ( j < containsLen-1 ) {
+					out << ", ";
+					if ( (j+1) % 16 == 0 )
+						out << "\n\t";
+				}
+			}
+			out << "\n};\n\n";
+		}
+	}
+
 	/*
 	 * lelInfo
 	 */
@@ -189,7 +211,12 @@ void PdaCodeGen::writeRuntimeData( colm_sections *runtimeData, struct pda_tables
 		out << el->term_dup_id << ", ";
 		out << el->mark_id << ", ";
 		out << el->capture_attr << ", ";
-		out << el->num_capture_attr;
+		out << el->num_capture_attr << ", ";
+
+		if ( el->contains != 0 )
+			out << "contains_" << i;
+		else
+			out << "0";
 
 		out << " }";
 
@@ -384,6 +411,7 @@ void PdaCodeGen::writeRuntimeData( colm_sections *runtimeData, struct pda_tables
 				runtimeData->generic_info[i].el_offset << ", " <<
 				runtimeData->generic_info[i].key_type << ", " <<
 				runtimeData->generic_info[i].key_offset << ", " <<
+				runtimeData->generic_info[i].key_cmp << ", " <<
 				runtimeData->generic_info[i].value_type << ", " <<
 				runtimeData->generic_info[i].value_offset << ", " <<
 				runtimeData->generic_info[i].parser_id;
@@ -451,6 +479,8 @@ void PdaCodeGen::writeRuntimeData( colm_sections *runtimeData, struct pda_tables
 		"int " << objectName << "_reducer_need_ign( program_t *prg, "
 				"struct pda_run *pda_run );\n"
 		"void " << objectName << "_read_reduce( program_t *prg, int reducer, input_t *stream );\n"
+		"int " << objectName << "_match_pattern( program_t *prg, long pattern_id,\n"
+		"		tree_t **bindings, kid_t *kid );\n"
 		"\n";
 
 	out <<
@@ -527,109 +557,58 @@ void PdaCodeGen::writeRuntimeData( colm_sections *runtimeData, struct pda_tables
 		"	&" << objectName << "_reducer_need_tok,\n"
 		"	&" << objectName << "_reducer_need_ign,\n"
 		"	&" << objectName << "_read_reduce,\n" 
+		"	&" << objectName << "_match_pattern,\n"
 		"};\n"
 		"\n";
 }
 
-void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
+String PdaCodeGen::arrayType( int width, bool isSigned )
 {
-	String prefix = "pid_" + String(0, "%ld", id) + "_";
-
-	out << "static int " << prefix << indicies() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_indicies; i++ ) {
-		out << tables->indicies[i];
-
-		if ( i < tables->num_indicies-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
-
-	out << "static int " << prefix << owners() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_indicies; i++ ) {
-		out << tables->owners[i];
-
-		if ( i < tables->num_indicies-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
-
-	out << "static int " << prefix << keys() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_keys; i++ ) {
-		out << tables->keys[i];
-
-		if ( i < tables->num_keys-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
+	switch ( width ) {
+		case 1: return isSigned ? "signed char" : "unsigned char";
+		case 2: return isSigned ? "short" : "unsigned short";
 	}
-	out << "\n};\n\n";
-
-	out << "static unsigned int " << prefix << offsets() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_states; i++ ) {
-		out << tables->offsets[i];
-
-		if ( i < tables->num_states-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
-
-	out << "static unsigned int " << prefix << targs() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_targs; i++ ) {
-		out << tables->targs[i];
-
-		if ( i < tables->num_targs-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
-
-	out << "static unsigned int " << prefix << actInds() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_act_inds; i++ ) {
-		out << tables->act_inds[i];
-
-		if ( i < tables->num_act_inds-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
+	return isSigned ? "int" : "unsigned int";
+}
 
-	out << "static unsigned int " << prefix << actions() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_actions; i++ ) {
-		out << tables->actions[i];
+void PdaCodeGen::writeTable( String name, const void *table, int width,
+		bool isSigned, long len )
+{
+	out << "static const " << arrayType( width, isSigned ) <<
+			" " << name << "[] = {\n\t";
+	for ( long i = 0; i < len; i++ ) {
+		if ( isSigned )
+			out << pda_table_int( table, width, i );
+		else
+			out << pda_table_uint( table, width, i );
 
-		if ( i < tables->num_actions-1 ) {
+		if ( i < len-1 ) {
 			out << ", ";
 			if ( (i+1) % 8 == 0 )
 				out << "\n\t";
 		}
 	}
 	out << "\n};\n\n";
+}
 
-	out << "static int " << prefix << commitLen() << "[] = {\n\t";
-	for ( int i = 0; i < tables->num_commit_len; i++ ) {
-		out << tables->commit_len[i];
+void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
+{
+	String prefix = "pid_" + String(0, "%ld", id) + "_";
 
-		if ( i < tables->num_commit_len-1 ) {
-			out << ", ";
-			if ( (i+1) % 8 == 0 )
-				out << "\n\t";
-		}
-	}
-	out << "\n};\n\n";
+	writeTable( prefix + indicies(), tables->indicies,
+			tables->indicies_width, true, tables->num_indicies * 2 );
+	writeTable( prefix + keys(), tables->keys,
+			tables->keys_width, true, tables->num_keys );
+	writeTable( prefix + offsets(), tables->offsets,
+			tables->offsets_width, false, tables->num_states );
+	writeTable( prefix + targs(), tables->targs,
+			tables->targs_width, false, tables->num_targs );
+	writeTable( prefix + actInds(), tables->act_inds,
+			tables->act_inds_width, false, tables->num_act_inds );
+	writeTable( prefix + actions(), tables->actions,
+			tables->actions_width, false, tables->num_actions );
+	writeTable( prefix + commitLen(), tables->commit_len,
+			tables->commit_len_width, true, tables->num_commit_len );
 
 	out << "static int " << prefix << tokenRegionInds() << "[] = {\n\t";
 	for ( int i = 0; i < tables->num_states; i++ ) {
@@ -671,7 +650,6 @@ void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
 		"static struct pda_tables " << prefix << "pdaTables =\n"
 		"{\n"
 		"	" << prefix << indicies() << ",\n"
-		"	" << prefix << owners() << ",\n"
 		"	" << prefix << keys() << ",\n"
 		"	" << prefix << offsets() << ",\n"
 		"	" << prefix << targs() << ",\n"
@@ -691,7 +669,15 @@ void PdaCodeGen::writeParserData( long id, struct pda_tables *tables )
 		"	" << tables->num_actions << ",\n"
 		"	" << tables->num_commit_len << ",\n"
 		"	" << tables->num_region_items << ",\n"
-		"	" << tables->num_pre_region_items << "\n"
+		"	" << tables->num_pre_region_items << ",\n"
+		"\n"
+		"	" << tables->indicies_width << ",\n"
+		"	" << tables->keys_width << ",\n"
+		"	" << tables->offsets_width << ",\n"
+		"	" << tables->targs_width << ",\n"
+		"	" << tables->act_inds_width << ",\n"
+		"	" << tables->actions_width << ",\n"
+		"	" << tables->commit_len_width << "\n"
 		"};\n"
 		"\n";
 }
@@ -47,12 +47,14 @@ struct PdaCodeGen
 	void defineRuntime();
 	void writeRuntimeData( colm_sections *runtimeData, struct pda_tables *pdaTables );
 	void writeParserData( long id, struct pda_tables *tables );
+	String arrayType( int width, bool isSigned );
+	void writeTable( String name, const void *table, int width,
+			bool isSigned, long len );
 
 	String PARSER() { return "parser_"; }
 
 	String startState() { return PARSER() + "startState"; }
 	String indicies() { return PARSER() + "indicies"; }
-	String owners() { return PARSER() + "owners"; }
 	String keys() { return PARSER() + "keys"; }
 	String offsets() { return PARSER() + "offsets"; }
 	String targs() { return PARSER() + "targs"; }
@@ -23,6 +23,7 @@
 #include "pdarun.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -101,25 +102,40 @@ void colm_decrement_steps( struct pda_run *pda_run )
 	//debug( prg, REALM_PARSE, "steps down to %ld\n", pdaRun->steps );
 }
 
-head_t *colm_stream_pull( program_t *prg, tree_t **sp, struct pda_run *pda_run,
+/* Token data that lives as long as the program. Taken straight from the
+ * input when it can hand out such pointers, otherwise copied into a consume
+ * buffer. */
+static const char *token_data( program_t *prg, struct pda_run *pda_run,
 		struct input_impl *is, long length )
 {
-	if ( pda_run != 0 ) {
-		struct run_buf *run_buf = pda_run->consume_buf;
-		if ( length > ( FSM_BUFSIZE - run_buf->length ) ) {
-			run_buf = new_run_buf( 0 );
-			run_buf->next = pda_run->consume_buf;
-			pda_run->consume_buf = run_buf;
-		}
+	if ( length > 0 && is->funcs->get_data_pointer != 0 ) {
+		const char *data = is->funcs->get_data_pointer( prg, is, length );
+		if ( data != 0 )
+			return data;
+	}
 
-		char *dest = run_buf->data + run_buf->length;
+	struct run_buf *run_buf = pda_run->consume_buf;
+	if ( run_buf == 0 || length > ( run_buf->size - run_buf->length ) ) {
+		run_buf = new_run_buf( prg, length );
+		run_buf->next = pda_run->consume_buf;
+		pda_run->consume_buf = run_buf;
+	}
 
-		is->funcs->get_data( prg, is, dest, length );
+	char *dest = run_buf->data + run_buf->length;
+	is->funcs->get_data( prg, is, dest, length );
+	run_buf->length += length;
+
+	return dest;
+}
+
+head_t *colm_stream_pull( program_t *prg, tree_t **sp, struct pda_run *pda_run,
+		struct input_impl *is, long length )
+{
+	if ( pda_run != 0 ) {
+		const char *dest = token_data( prg, pda_run, is, length );
 		location_t *loc = location_allocate( prg );
 		is->funcs->consume_data( prg, is, length, loc );
 
-		run_buf->length += length;
-
 		pda_run->p = pda_run->pe = 0;
 		pda_run->toklen = 0;
 
@@ -304,13 +320,79 @@ static void send_back( program_t *prg, tree_t **sp, struct pda_run *pda_run,
 static void set_region( struct pda_run *pda_run, int empty_ignore, parse_tree_t *tree )
 {
 	if ( empty_ignore ) {
-		/* Recording the next region. */
-		tree->retry_region = pda_run->next_region_ind;
-		if ( pda_run->pda_tables->token_regions[tree->retry_region+1] != 0 )
+		/* Recording the next region. Only needed if there is another region
+		 * to retry in, without one backtracking behaves as if it were zero. */
+		if ( pda_run->pda_tables->token_regions[pda_run->next_region_ind+1] != 0 ) {
+			parse_tree_ext( pda_run, tree )->retry_region = pda_run->next_region_ind;
 			pda_run->num_retry += 1;
+		}
 	}
 }
 
+/* Is there anything in the uncommitted part of the stack that backtracking
+ * could still return to? */
+static int pending_retry( program_t *prg, tree_t **root, struct pda_run *pda_run )
+{
+	tree_t **sp = root;
+	parse_tree_t *top, *pt;
+
+	for ( top = pda_run->stack_top; top != 0 && !( top->flags & PF_COMMITTED );
+			top = top->next )
+	{
+		pt = top;
+walk:
+		if ( pt->retry_lower != 0 || pt->retry_upper != 0 ||
+				( pt->ext != 0 && pt->ext->retry_region != 0 ) )
+			return true;
+
+		if ( pt != top && pt->next != 0 )
+			vm_push_ptree( pt->next );
+
+		/* Committed subtrees have no children left. */
+		if ( !( pt->flags & PF_COMMITTED ) ) {
+			if ( pt->child != 0 )
+				vm_push_ptree( pt->child );
+
+			if ( pt->ext != 0 && pt->ext->left_ignore != 0 )
+				vm_push_ptree( pt->ext->left_ignore );
+
+			if ( pt->ext != 0 && pt->ext->right_ignore != 0 )
+				vm_push_ptree( pt->ext->right_ignore );
+		}
+
+		if ( sp != root ) {
+			pt = vm_pop_ptree();
+			goto walk;
+		}
+	}
+
+	return false;
+}
+
+/* Decide if the shift that just happened should be followed by a commit.
+ * Not done in a reverting context, since undoing the parse needs to back up
+ * past it. While retries block it, checks back off so the walk over the
+ * uncommitted trees stays proportional to the input. */
+static int auto_commit_point( program_t *prg, tree_t **sp, struct pda_run *pda_run )
+{
+	if ( prg->auto_commit == 0 || pda_run->revert_on ||
+			pda_run->shift_count < pda_run->auto_commit_next )
+		return false;
+
+	if ( pda_run->auto_commit_wait == 0 )
+		pda_run->auto_commit_wait = prg->auto_commit;
+
+	if ( pending_retry( prg, sp, pda_run ) ) {
+		pda_run->auto_commit_wait *= 2;
+		pda_run->auto_commit_next = pda_run->shift_count + pda_run->auto_commit_wait;
+		return false;
+	}
+
+	pda_run->auto_commit_wait = prg->auto_commit;
+	pda_run->auto_commit_next = pda_run->shift_count + prg->auto_commit;
+	return true;
+}
+
 static void ignore_tree( program_t *prg, struct pda_run *pda_run, tree_t *tree )
 {
 	int empty_ignore = pda_run->accum_ignore == 0;
@@ -511,7 +593,8 @@ static void attach_right_ignore( program_t *prg, tree_t **sp,
 		}
 
 		/* Last is now the first. */
-		parse_tree->right_ignore = last;
+		if ( last != 0 || parse_tree->ext != 0 )
+			parse_tree_ext( pda_run, parse_tree )->right_ignore = last;
 
 		if ( data_child != 0 ) {
 			debug( prg, REALM_PARSE, "attaching ignore right\n" );
@@ -570,7 +653,8 @@ static void attach_left_ignore( program_t *prg, tree_t **sp,
 	}
 
 	/* Last is now the first. */
-	parse_tree->left_ignore = last;
+	if ( last != 0 || parse_tree->ext != 0 )
+		parse_tree_ext( pda_run, parse_tree )->left_ignore = last;
 
 	if ( data_child != 0 ) {
 		debug( prg, REALM_PARSE, "attaching left ignore\n" );
@@ -609,12 +693,12 @@ static void detach_right_ignore( program_t *prg, tree_t **sp,
 		parse_tree->flags &= ~PF_RIGHT_IL_ATTACHED;
 	}
 
-	if ( parse_tree->right_ignore != 0 ) {
+	if ( parse_tree->ext != 0 && parse_tree->ext->right_ignore != 0 ) {
 		assert( right_ignore != 0 );
 
 		/* Transfer the trees to accumIgnore. */
-		parse_tree_t *ignore = parse_tree->right_ignore;
-		parse_tree->right_ignore = 0;
+		parse_tree_t *ignore = parse_tree->ext->right_ignore;
+		parse_tree->ext->right_ignore = 0;
 
 		kid_t *data_ignore = right_ignore->child;
 		right_ignore->child = 0;
@@ -661,12 +745,12 @@ static void detach_left_ignore( program_t *prg, tree_t **sp,
 		parse_tree->flags &= ~PF_LEFT_IL_ATTACHED;
 	}
 
-	if ( parse_tree->left_ignore != 0 ) {
+	if ( parse_tree->ext != 0 && parse_tree->ext->left_ignore != 0 ) {
 		assert( left_ignore != 0 );
 
 		/* Transfer the trees to accumIgnore. */
-		parse_tree_t *ignore = parse_tree->left_ignore;
-		parse_tree->left_ignore = 0;
+		parse_tree_t *ignore = parse_tree->ext->left_ignore;
+		parse_tree->ext->left_ignore = 0;
 
 		kid_t *data_ignore = left_ignore->child;
 		left_ignore->child = 0;
@@ -729,21 +813,10 @@ static head_t *extract_match( program_t *prg, tree_t **sp,
 
 	//debug( prg, REALM_PARSE, "extracting token of length: %ld\n", length );
 
-	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( length );
-		run_buf->next = pda_run->consume_buf;
-		pda_run->consume_buf = run_buf;
-	}
-
-	char *dest = run_buf->data + run_buf->length;
-
-	is->funcs->get_data( prg, is, dest, length );
+	const char *dest = token_data( prg, pda_run, is, length );
 	location_t *location = location_allocate( prg );
 	is->funcs->consume_data( prg, is, length, location );
 
-	run_buf->length += length;
-
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
 	pda_run->tokstart = 0;
@@ -786,24 +859,13 @@ static head_t *extract_no_l( program_t *prg, tree_t **sp,
 
 	//debug( prg, REALM_PARSE, "extracting token of length: %ld\n", length );
 
-	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( length );
-		run_buf->next = pda_run->consume_buf;
-		pda_run->consume_buf = run_buf;
-	}
-
-	char *dest = run_buf->data + run_buf->length;
-
-	is->funcs->get_data( prg, is, dest, length );
+	const char *dest = token_data( prg, pda_run, is, length );
 
 	/* Using a dummpy location. */
 	location_t location;
 	memset( &location, 0, sizeof( location ) );
 	is->funcs->consume_data( prg, is, length, &location );
 
-	run_buf->length += length;
-
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
 	pda_run->tokstart = 0;
@@ -842,16 +904,7 @@ static head_t *peek_match( program_t *prg, struct pda_run *pda_run, struct input
 {
 	long length = pda_run->toklen;
 
-	struct run_buf *run_buf = pda_run->consume_buf;
-	if ( run_buf == 0 || length > ( FSM_BUFSIZE - run_buf->length ) ) {
-		run_buf = new_run_buf( 0 );
-		run_buf->next = pda_run->consume_buf;
-		pda_run->consume_buf = run_buf;
-	}
-
-	char *dest = run_buf->data + run_buf->length;
-
-	is->funcs->get_data( prg, is, dest, length );
+	const char *dest = token_data( prg, pda_run, is, length );
 
 	pda_run->p = pda_run->pe = 0;
 	pda_run->toklen = 0;
@@ -1079,6 +1132,296 @@ static void push_bt_point( program_t *prg, struct pda_run *pda_run )
 }
 
 
+/*
+ * Backtracking memo. When backtracking returns to a retry point every
+ * alternative tried so far has failed. If the same configuration comes up
+ * again, those alternatives are skipped. The final alternative is never
+ * recorded, there is no retry point left to observe its failure from.
+ */
+
+#define BT_MEMO_INIT   1024
+#define BT_MEMO_MAX    65536
+#define BT_STACKS_INIT 1024
+
+static unsigned int bt_stack_hash( unsigned int parent, int id, int state )
+{
+	unsigned int h = parent * 0x9e3779b1u;
+	h = ( h ^ ( ( (unsigned int)id << 20 ) ^ (unsigned int)( state + 1 ) ) ) * 0x9e3779b1u;
+	return h ^ ( h >> 15 );
+}
+
+static void bt_stacks_grow_tab( struct bt_stacks *bs )
+{
+	unsigned int i, size = bs->tab_size == 0 ? BT_STACKS_INIT : bs->tab_size * 2;
+
+	free( bs->tab );
+	bs->tab = calloc( size, sizeof(unsigned int) );
+	bs->tab_size = size;
+
+	for ( i = 1; i < bs->len; i++ ) {
+		struct bt_stack_el *el = &bs->els[i];
+		if ( el->refs > 0 ) {
+			unsigned int h = bt_stack_hash( el->parent, el->id, el->state ) & ( size - 1 );
+			el->next = bs->tab[h];
+			bs->tab[h] = i;
+		}
+	}
+}
+
+/* Returns the stack of the given element pushed onto parent, with a
+ * reference taken for the caller. */
+static unsigned int bt_stack_intern( struct bt_stacks *bs,
+		unsigned int parent, int id, int state )
+{
+	if ( ( bs->live + 1 ) * 2 > bs->tab_size )
+		bt_stacks_grow_tab( bs );
+
+	unsigned int h = bt_stack_hash( parent, id, state ) & ( bs->tab_size - 1 );
+	unsigned int s;
+	for ( s = bs->tab[h]; s != 0; s = bs->els[s].next ) {
+		struct bt_stack_el *el = &bs->els[s];
+		if ( el->parent == parent && el->id == id && el->state == state ) {
+			el->refs += 1;
+			return s;
+		}
+	}
+
+	if ( bs->free_list != 0 ) {
+		s = bs->free_list;
+		bs->free_list = bs->els[s].next;
+	}
+	else {
+		if ( bs->len == bs->alloc ) {
+			bs->alloc = bs->alloc == 0 ? BT_STACKS_INIT : bs->alloc * 2;
+			bs->els = realloc( bs->els, sizeof(struct bt_stack_el) * bs->alloc );
+			if ( bs->len == 0 )
+				bs->len = 1;
+		}
+		s = bs->len++;
+	}
+
+	struct bt_stack_el *el = &bs->els[s];
+	el->parent = parent;
+	el->id = id;
+	el->state = state;
+	el->refs = 1;
+	el->next = bs->tab[h];
+	bs->tab[h] = s;
+	bs->live += 1;
+
+	if ( parent != 0 )
+		bs->els[parent].refs += 1;
+
+	return s;
+}
+
+/* Drop a reference. A stack nothing refers to any more is unlinked, which
+ * drops its reference to the stack below it. */
+void colm_bt_stack_release( struct pda_run *pda_run, unsigned int stack )
+{
+	struct bt_stacks *bs = &pda_run->bt_stacks;
+
+	while ( stack != 0 ) {
+		struct bt_stack_el *el = &bs->els[stack];
+		el->refs -= 1;
+		if ( el->refs > 0 )
+			break;
+
+		unsigned int *link = &bs->tab[bt_stack_hash( el->parent,
+				el->id, el->state ) & ( bs->tab_size - 1 )];
+		while ( *link != stack )
+			link = &bs->els[*link].next;
+		*link = el->next;
+
+		unsigned int parent = el->parent;
+		el->next = bs->free_list;
+		bs->free_list = stack;
+		bs->live -= 1;
+
+		stack = parent;
+	}
+}
+
+static void bt_stacks_clear( struct bt_stacks *bs )
+{
+	free( bs->els );
+	free( bs->tab );
+	free( bs->path );
+	memset( bs, 0, sizeof(struct bt_stacks) );
+}
+
+/* An element pushed onto the stack has a new stack below it. The stack is
+ * interned again when a lookup needs it. */
+static void stack_pushed( struct pda_run *pda_run, parse_tree_t *pt )
+{
+	if ( pt->stack != 0 ) {
+		colm_bt_stack_release( pda_run, pt->stack );
+		pt->stack = 0;
+	}
+}
+
+/* Interns the stack from the top down. Elements keep their stack while they
+ * stay on the stack, so only those pushed since the last lookup are visited. */
+static unsigned int stack_of( struct pda_run *pda_run, parse_tree_t *top )
+{
+	struct bt_stacks *bs = &pda_run->bt_stacks;
+	parse_tree_t *pt = top;
+	long n = 0;
+
+	while ( pt != 0 && pt->stack == 0 ) {
+		if ( n == bs->path_len ) {
+			bs->path_len = bs->path_len == 0 ? BT_STACKS_INIT : bs->path_len * 2;
+			bs->path = realloc( bs->path, sizeof(parse_tree_t*) * bs->path_len );
+		}
+		bs->path[n++] = pt;
+		pt = pt->next;
+	}
+
+	unsigned int parent = pt != 0 ? pt->stack : 0;
+	while ( n > 0 ) {
+		pt = bs->path[--n];
+		pt->stack = bt_stack_intern( bs, parent, pt->id, pt->state );
+		parent = pt->stack;
+	}
+
+	return top->stack;
+}
+
+/* Tokens that did not come from the input have no location and are not
+ * memoized. The position is taken across all the streams of the input, a
+ * stream appended later starts counting its own bytes from zero. */
+static int bt_memo_key( struct pda_run *pda_run, parse_tree_t *lel,
+		int state, struct bt_memo_el *key )
+{
+	if ( lel->shadow == 0 || lel->shadow->tree == 0 )
+		return 0;
+
+	head_t *tokdata = lel->shadow->tree->tokdata;
+	if ( tokdata == 0 || tokdata->location == 0 || tokdata->location->line == 0 )
+		return 0;
+
+	key->stack = stack_of( pda_run, pda_run->stack_top );
+	key->byte = tokdata->location->input_byte;
+	key->length = tokdata->length;
+	key->state = state;
+	key->id = lel->id;
+	key->alt = 0;
+	return 1;
+}
+
+static long bt_memo_hash( struct bt_memo_el *key, int alt )
+{
+	unsigned long h = key->stack;
+	h = h * 31 + (unsigned long)key->byte;
+	h = h * 31 + (unsigned long)key->length;
+	h = h * 31 + (unsigned long)key->state;
+	h = h * 31 + (unsigned long)key->id;
+	h = h * 31 + (unsigned long)alt;
+	return (long)( ( h ^ ( h >> 17 ) ) & LONG_MAX );
+}
+
+static int bt_memo_match( struct bt_memo_el *el, struct bt_memo_el *key, int alt )
+{
+	return el->alt == alt + 1 && el->stack == key->stack && el->byte == key->byte &&
+			el->length == key->length && el->state == key->state && el->id == key->id;
+}
+
+static int bt_memo_failed( struct pda_run *pda_run, struct bt_memo_el *key, int alt )
+{
+	struct bt_memo *memo = &pda_run->bt_memo;
+	if ( memo->used == 0 )
+		return 0;
+
+	long i = bt_memo_hash( key, alt ) & ( memo->size - 1 );
+	while ( memo->tab[i].alt != 0 ) {
+		if ( bt_memo_match( &memo->tab[i], key, alt ) )
+			return 1;
+		i = ( i + 1 ) & ( memo->size - 1 );
+	}
+	return 0;
+}
+
+/* Returns zero if the entry was already there. */
+static int bt_memo_insert( struct bt_memo *memo, struct bt_memo_el *key, int alt )
+{
+	long i = bt_memo_hash( key, alt ) & ( memo->size - 1 );
+	while ( memo->tab[i].alt != 0 ) {
+		if ( bt_memo_match( &memo->tab[i], key, alt ) )
+			return 0;
+		i = ( i + 1 ) & ( memo->size - 1 );
+	}
+
+	memo->tab[i] = *key;
+	memo->tab[i].alt = alt + 1;
+	memo->used += 1;
+	return 1;
+}
+
+static void bt_memo_record( program_t *prg, struct pda_run *pda_run,
+		parse_tree_t *lel, int state, int alt )
+{
+	struct bt_memo *memo = &pda_run->bt_memo;
+	struct bt_memo_el key;
+
+	if ( !prg->bt_memo || !bt_memo_key( pda_run, lel, state, &key ) )
+		return;
+
+	/* Keep the load at or below half. Grow up to the max, after that start
+	 * over, it is only a cache. */
+	if ( ( memo->used + 1 ) * 2 > memo->size ) {
+		if ( memo->size >= BT_MEMO_MAX ) {
+			long i;
+			for ( i = 0; i < memo->size; i++ ) {
+				if ( memo->tab[i].alt != 0 )
+					colm_bt_stack_release( pda_run, memo->tab[i].stack );
+			}
+
+			memset( memo->tab, 0, sizeof(struct bt_memo_el) * memo->size );
+			memo->used = 0;
+			memo->flushed += 1;
+		}
+		else {
+			struct bt_memo_el *old_tab = memo->tab;
+			long i, old_size = memo->size;
+
+			memo->size = old_size == 0 ? BT_MEMO_INIT : old_size * 2;
+			memo->tab = calloc( memo->size, sizeof(struct bt_memo_el) );
+			memo->used = 0;
+
+			for ( i = 0; i < old_size; i++ ) {
+				if ( old_tab[i].alt != 0 )
+					bt_memo_insert( memo, &old_tab[i], old_tab[i].alt - 1 );
+			}
+			free( old_tab );
+		}
+	}
+
+	debug( prg, REALM_PARSE, "memoizing failed alternative %d of %s in state %d\n",
+			alt, prg->rtd->lel_info[lel->id].name, state );
+
+	/* The entry keeps its stack. */
+	if ( bt_memo_insert( memo, &key, alt ) )
+		pda_run->bt_stacks.els[key.stack].refs += 1;
+	memo->recorded += 1;
+}
+
+static void bt_memo_clear( program_t *prg, struct pda_run *pda_run )
+{
+	struct bt_memo *memo = &pda_run->bt_memo;
+
+	if ( memo->recorded > 0 ) {
+		debug( prg, REALM_PARSE, "backtracking memo: recorded %ld, "
+				"pruned %ld, flushed %ld\n",
+				memo->recorded, memo->pruned, memo->flushed );
+	}
+
+	free( memo->tab );
+	memset( memo, 0, sizeof(struct bt_memo) );
+
+	/* Every element of the parse stack is gone by now. */
+	bt_stacks_clear( &pda_run->bt_stacks );
+}
+
 #define SCAN_UNDO              -7
 #define SCAN_IGNORE            -6
 #define SCAN_TREE              -5
@@ -1215,16 +1558,16 @@ free_tree:
 		vm_push_ptree( pt->next );
 	}
 
-	if ( pt->left_ignore != 0 ) {
-		vm_push_ptree( pt->left_ignore );
+	if ( pt->ext != 0 && pt->ext->left_ignore != 0 ) {
+		vm_push_ptree( pt->ext->left_ignore );
 	}
 
 	if ( pt->child != 0 ) {
 		vm_push_ptree( pt->child );
 	}
 
-	if ( pt->right_ignore != 0 ) {
-		vm_push_ptree( pt->right_ignore );
+	if ( pt->ext != 0 && pt->ext->right_ignore != 0 ) {
+		vm_push_ptree( pt->ext->right_ignore );
 	}
 
 	if ( pt->shadow != 0 ) {
@@ -1282,6 +1625,8 @@ void colm_pda_clear( program_t *prg, tree_t **sp, struct pda_run *pda_run )
 
 	colm_tree_downref( prg, sp, pda_run->parse_error_text );
 
+	bt_memo_clear( prg, pda_run );
+
 	if ( pda_run->reducer ) {
 		long local_lost = pool_alloc_num_lost( &pda_run->local_pool );
 
@@ -1307,6 +1652,7 @@ void colm_pda_init( program_t *prg, struct pda_run *pda_run, struct pda_tables *
 	 * shifts and think parsing cannot continue. */
 	pda_run->shift_count = 0;
 	pda_run->commit_shift_count = -1;
+	pda_run->auto_commit_next = prg->auto_commit;
 
 	if ( reducer ) {
 		init_pool_alloc( &pda_run->local_pool, sizeof(parse_tree_t) +
@@ -1316,6 +1662,7 @@ void colm_pda_init( program_t *prg, struct pda_run *pda_run, struct pda_tables *
 	else {
 		pda_run->parse_tree_pool = &prg->parse_tree_pool;
 	}
+	pda_run->parse_ext_pool = &prg->parse_ext_pool;
 
 	debug( prg, REALM_PARSE, "initializing struct pda_run %s\n",
 		prg->rtd->lel_info[prg->rtd->parser_lel_ids[parser_id]].name );
@@ -1369,11 +1716,12 @@ static long stack_top_target( program_t *prg, struct pda_run *pda_run )
 	if ( pda_run->stack_top->state < 0 )
 		state = prg->rtd->start_states[pda_run->parser_id];
 	else {
+		struct pda_tables *tables = pda_run->pda_tables;
 		unsigned shift = pda_run->stack_top->id - 
-				pda_run->pda_tables->keys[pda_run->stack_top->state<<1];
-		unsigned offset = pda_run->pda_tables->offsets[pda_run->stack_top->state] + shift;
-		int index = pda_run->pda_tables->indicies[offset];
-		state = pda_run->pda_tables->targs[index];
+				pda_key( tables, pda_run->stack_top->state<<1 );
+		unsigned offset = pda_offset( tables, pda_run->stack_top->state ) + shift;
+		int index = pda_index( tables, offset );
+		state = pda_targ( tables, index );
 	}
 	return state;
 }
@@ -1391,8 +1739,10 @@ static long stack_top_target( program_t *prg, struct pda_run *pda_run )
 static long parse_token( program_t *prg, tree_t **sp,
 		struct pda_run *pda_run, struct input_impl *is, long entry )
 {
-	int pos;
-	unsigned int *action;
+	struct pda_tables *tables = pda_run->pda_tables;
+	int pos, low_key;
+	long action;
+	unsigned int act, next_act;
 	int rhs_len;
 	int owner;
 	int induce_reject;
@@ -1421,25 +1771,26 @@ again:
 	pda_run->lel = pda_run->parse_input;
 	pda_run->cur_state = pda_run->pda_cs;
 
-	if ( pda_run->lel->id < pda_run->pda_tables->keys[pda_run->cur_state<<1] ||
-			pda_run->lel->id > pda_run->pda_tables->keys[(pda_run->cur_state<<1)+1] )
+	low_key = pda_key( tables, pda_run->cur_state<<1 );
+	if ( pda_run->lel->id < low_key ||
+			pda_run->lel->id > pda_key( tables, (pda_run->cur_state<<1)+1 ) )
 	{
 		debug( prg, REALM_PARSE, "parse error, no transition 1\n" );
 		push_bt_point( prg, pda_run );
 		goto parse_error;
 	}
 
-	ind_pos = pda_run->pda_tables->offsets[pda_run->cur_state] + 
-		(pda_run->lel->id - pda_run->pda_tables->keys[pda_run->cur_state<<1]);
+	ind_pos = pda_offset( tables, pda_run->cur_state ) + 
+		(pda_run->lel->id - low_key);
 
-	owner = pda_run->pda_tables->owners[ind_pos];
+	owner = pda_owner( tables, ind_pos );
 	if ( owner != pda_run->cur_state ) {
 		debug( prg, REALM_PARSE, "parse error, no transition 2\n" );
 		push_bt_point( prg, pda_run );
 		goto parse_error;
 	}
 
-	pos = pda_run->pda_tables->indicies[ind_pos];
+	pos = pda_index( tables, ind_pos );
 	if ( pos < 0 ) {
 		debug( prg, REALM_PARSE, "parse error, no transition 3\n" );
 		push_bt_point( prg, pda_run );
@@ -1449,16 +1800,38 @@ again:
 	/* Checking complete. */
 
 	induce_reject = false;
-	pda_run->pda_cs = pda_run->pda_tables->targs[pos];
-	action = pda_run->pda_tables->actions + pda_run->pda_tables->act_inds[pos];
+	pda_run->pda_cs = pda_targ( tables, pos );
+	action = pda_act_ind( tables, pos );
 	if ( pda_run->lel->retry_lower )
 		action += pda_run->lel->retry_lower;
 
+	/* Skip alternatives already known to fail from this configuration. */
+	next_act = pda_action( tables, action + 1 );
+	if ( next_act != 0 && pda_run->bt_memo.used > 0 &&
+			pda_run->lel->id < prg->rtd->first_non_term_id )
+	{
+		struct bt_memo_el key;
+		if ( bt_memo_key( pda_run, pda_run->lel, pda_run->cur_state, &key ) ) {
+			while ( next_act != 0 && bt_memo_failed( pda_run, &key,
+					pda_run->lel->retry_lower ) )
+			{
+				debug( prg, REALM_PARSE, "skipping failed alternative %d\n",
+						pda_run->lel->retry_lower );
+				pda_run->bt_memo.pruned += 1;
+				pda_run->lel->retry_lower += 1;
+				action += 1;
+				next_act = pda_action( tables, action + 1 );
+			}
+		}
+	}
+
+	act = pda_action( tables, action );
+
 	/*
 	 * Shift
 	 */
 
-	if ( *action & act_sb ) {
+	if ( act & act_sb ) {
 		debug( prg, REALM_PARSE, "shifted: %s\n", 
 				prg->rtd->lel_info[pda_run->lel->id].name );
 		/* Consume. */
@@ -1475,6 +1848,7 @@ again:
 
 		pda_run->lel->next = pda_run->stack_top;
 		pda_run->stack_top = pda_run->lel;
+		stack_pushed( pda_run, pda_run->stack_top );
 
 		/* If its a token then attach ignores and record it in the token list
 		 * of the next ignore attachment to use. */
@@ -1488,7 +1862,7 @@ again:
 			pda_run->token_list = ref;
 		}
 
-		if ( action[1] == 0 )
+		if ( next_act == 0 )
 			pda_run->lel->retry_lower = 0;
 		else {
 			debug( prg, REALM_PARSE, "retry: %p\n", pda_run->stack_top );
@@ -1505,13 +1879,38 @@ again:
 	 * Commit
 	 */
 
-	if ( pda_run->pda_tables->commit_len[pos] != 0 ) {
+	if ( pda_commit_len( tables, pos ) != 0 ||
+			( ( act & act_sb ) && auto_commit_point( prg, sp, pda_run ) ) )
+	{
 		debug( prg, REALM_PARSE, "commit point\n" );
 		pda_run->commit_shift_count = pda_run->shift_count;
 
+		/* Freeing the undo state is asked for with automatic commits and
+		 * needed for printing commits. Otherwise a commit point only commits
+		 * a reducer. */
+		int clear_undo = !pda_run->revert_on &&
+				( prg->auto_commit > 0 || pda_run->stream_commits );
+
 		/* Not in a reverting context and the parser result is not used. */
 		if ( pda_run->reducer )
 			commit_reduce( prg, sp, pda_run );
+		else if ( clear_undo ) {
+			commit_clear_undo( prg, sp, pda_run );
+			if ( pda_run->stream_commits )
+				commit_print( prg, sp, pda_run );
+		}
+
+		/* Only the last token can be needed for attaching ignores. Anything
+		 * older would only be popped by backing up past the commit. */
+		if ( clear_undo && pda_run->token_list != 0 ) {
+			ref_t *ref = pda_run->token_list->next;
+			while ( ref != 0 ) {
+				ref_t *next = ref->next;
+				kid_free( prg, (kid_t*)ref );
+				ref = next;
+			}
+			pda_run->token_list->next = 0;
+		}
 
 		if ( pda_run->fail_parsing )
 			goto fail;
@@ -1522,17 +1921,17 @@ again:
 	 * Reduce
 	 */
 
-	if ( *action & act_rb ) {
+	if ( act & act_rb ) {
 		int r, object_length;
 		parse_tree_t *last, *child;
 		kid_t *attrs;
 		kid_t *data_last, *data_child;
 
 		/* If there was shift don't attach again. */
-		if ( !( *action & act_sb ) && pda_run->lel->id < prg->rtd->first_non_term_id )
+		if ( !( act & act_sb ) && pda_run->lel->id < prg->rtd->first_non_term_id )
 			attach_right_ignore( prg, sp, pda_run, pda_run->stack_top );
 
-		pda_run->reduction = *action >> 2;
+		pda_run->reduction = act >> 2;
 
 		if ( pda_run->parse_input != 0 )
 			pda_run->parse_input->cause_reduce += 1;
@@ -1577,6 +1976,12 @@ again:
 			/* Detach the parse tree from the data. */
 			child->shadow = 0;
 
+			/* Its stack is interned again if it is ever pushed back. */
+			if ( child->stack != 0 ) {
+				colm_bt_stack_release( pda_run, child->stack );
+				child->stack = 0;
+			}
+
 			/* Reverse list. */
 			child->next = last;
 			data_child->next = data_last;
@@ -1591,7 +1996,7 @@ again:
 
 		debug( prg, REALM_PARSE, "reduced: %s rhsLen %d\n",
 				prg->rtd->prod_info[pda_run->reduction].name, rhs_len );
-		if ( action[1] == 0 )
+		if ( next_act == 0 )
 			pda_run->red_lel->retry_upper = 0;
 		else {
 			pda_run->red_lel->retry_upper += 1;
@@ -1667,6 +2072,7 @@ again:
 			pda_run->red_lel->state = pda_run->cur_state;
 			pda_run->red_lel->next = pda_run->stack_top;
 			pda_run->stack_top = pda_run->red_lel;
+			stack_pushed( pda_run, pda_run->stack_top );
 			/* FIXME: What is the right argument here? */
 			push_bt_point( prg, pda_run );
 			goto parse_error;
@@ -1735,6 +2141,10 @@ parse_error:
 
 					pda_run->num_retry -= 1;
 					pda_run->pda_cs = pda_run->parse_input->state;
+
+					/* Everything tried from here so far has failed. */
+					bt_memo_record( prg, pda_run, pda_run->parse_input, pda_run->pda_cs,
+							pda_run->parse_input->retry_lower - 1 );
 					goto again;
 				}
 
@@ -1772,7 +2182,8 @@ parse_error:
 					pda_run->parse_input = pda_run->undo_lel;
 				}
 				else {
-					long region = pda_run->parse_input->retry_region;
+					parse_ext_t *ext = pda_run->parse_input->ext;
+					long region = ext != 0 ? ext->retry_region : 0;
 					pda_run->next = region > 0 ? region + 1 : 0;
 					pda_run->check_next = true;
 					pda_run->check_stop = true;
@@ -1814,6 +2225,7 @@ parse_error:
 					/* Push onto the stack. */
 					first->next = pda_run->stack_top;
 					pda_run->stack_top = first;
+					stack_pushed( pda_run, first );
 
 					/* Reattach the data and the parse tree. */
 					first->shadow = data_first;
@@ -1860,7 +2272,7 @@ parse_error:
 			pda_run->accum_ignore = pda_run->accum_ignore->next;
 			ignore->next = 0;
 
-			long region = ignore->retry_region;
+			long region = ignore->ext != 0 ? ignore->ext->retry_region : 0;
 			pda_run->next = region > 0 ? region + 1 : 0;
 			pda_run->check_next = true;
 			pda_run->check_stop = true;
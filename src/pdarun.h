@@ -151,8 +151,20 @@ struct lang_el_info
 	long mark_id;
 	long capture_attr;
 	long num_capture_attr;
+
+	/* Bitset of the language elements that can appear below this one. Zero
+	 * if unknown. */
+	const unsigned char *contains;
 };
 
+/* Can a tree of type search_id be found below a tree of type id? */
+static inline int lel_can_contain( const struct lang_el_info *lel_info,
+		long id, long search_id )
+{
+	const unsigned char *contains = lel_info[id].contains;
+	return contains == 0 || ( contains[search_id >> 3] & ( 1 << ( search_id & 7 ) ) );
+}
+
 struct struct_el_info
 {
 	long size;
@@ -212,17 +224,20 @@ typedef struct _CaptureAttr
 	long offset;
 } CaptureAttr;
 
+/* The tables read on every token are stored in the narrowest integer type
+ * that holds their values, with the width of each given in bytes. The
+ * indicies hold an owner and action set index pair per entry, so the owner
+ * check and the index load in parse_token touch the same cache line. */
 struct pda_tables
 {
 	/* Parser table data. */
-	int *indicies;
-	int *owners;
-	int *keys;
-	unsigned int *offsets;
-	unsigned int *targs;
-	unsigned int *act_inds;
-	unsigned int *actions;
-	int *commit_len;
+	const void *indicies;
+	const void *keys;
+	const void *offsets;
+	const void *targs;
+	const void *act_inds;
+	const void *actions;
+	const void *commit_len;
 	int *token_region_inds;
 	int *token_regions;
 	int *token_pre_regions;
@@ -236,8 +251,37 @@ struct pda_tables
 	int num_commit_len;
 	int num_region_items;
 	int num_pre_region_items;
+
+	/* Element widths. */
+	int indicies_width;
+	int keys_width;
+	int offsets_width;
+	int targs_width;
+	int act_inds_width;
+	int actions_width;
+	int commit_len_width;
 };
 
+/* Reading the tables. These are on the parse loop, so they are macros. */
+#define pda_table_int( table, width, i ) \
+	( (width) == 1 ? ((const signed char*)(table))[i] : \
+	  (width) == 2 ? ((const short*)(table))[i] : \
+	  ((const int*)(table))[i] )
+
+#define pda_table_uint( table, width, i ) \
+	( (width) == 1 ? ((const unsigned char*)(table))[i] : \
+	  (width) == 2 ? ((const unsigned short*)(table))[i] : \
+	  ((const unsigned int*)(table))[i] )
+
+#define pda_owner( t, i )      pda_table_int( (t)->indicies, (t)->indicies_width, (i) * 2 )
+#define pda_index( t, i )      pda_table_int( (t)->indicies, (t)->indicies_width, (i) * 2 + 1 )
+#define pda_key( t, i )        pda_table_int( (t)->keys, (t)->keys_width, i )
+#define pda_offset( t, i )     pda_table_uint( (t)->offsets, (t)->offsets_width, i )
+#define pda_targ( t, i )       pda_table_uint( (t)->targs, (t)->targs_width, i )
+#define pda_act_ind( t, i )    pda_table_uint( (t)->act_inds, (t)->act_inds_width, i )
+#define pda_action( t, i )     pda_table_uint( (t)->actions, (t)->actions_width, i )
+#define pda_commit_len( t, i ) pda_table_int( (t)->commit_len, (t)->commit_len_width, i )
+
 struct pool_block
 {
 	void *data;
@@ -257,6 +301,66 @@ struct pool_alloc
 	int sizeofT;
 };
 
+/* A parse stack interned for the backtracking memo. Stacks with the same
+ * elements, by id and state, get the same index, so comparing two stacks is
+ * comparing indices. Interned elements of the parse stack and memo entries
+ * each hold a reference. */
+struct bt_stack_el
+{
+	unsigned int parent;
+	int id;
+	int state;
+	unsigned int refs;
+
+	/* Next in the hash chain, or in the free list. */
+	unsigned int next;
+};
+
+struct bt_stacks
+{
+	/* Index zero is not used. */
+	struct bt_stack_el *els;
+	unsigned int len;
+	unsigned int alloc;
+	unsigned int free_list;
+	unsigned int live;
+
+	/* Chain heads. */
+	unsigned int *tab;
+	unsigned int tab_size;
+
+	/* Elements found not interned, while interning. */
+	parse_tree_t **path;
+	long path_len;
+};
+
+/* An alternative that is known to fail. Keyed on the parser configuration at
+ * the retry point: the state, the token and where it sits in the input, and
+ * the interned parse stack. All of it is compared on a lookup. */
+struct bt_memo_el
+{
+	unsigned int stack;
+	long byte;
+	int state;
+	int id;
+	long length;
+
+	/* Alternative plus one. Zero marks an empty slot. */
+	int alt;
+};
+
+struct bt_memo
+{
+	struct bt_memo_el *tab;
+	long size;
+	long used;
+
+	/* Counters. */
+	long recorded;
+	long pruned;
+	long flushed;
+};
+
 struct pda_run
 {
 	/*
@@ -278,6 +382,7 @@ struct pda_run
 	char return_result;
 	char skip_toklen;
 	char eof_term_recvd;
+	char tokens_shared;
 
 	char *mark[MARK_SLOTS];
 	long matched_token;
@@ -324,6 +429,11 @@ struct pda_run
 	long shift_count;
 	long commit_shift_count;
 
+	/* Shift count at which to next consider an automatic commit, and the
+	 * distance to the one after, which grows while retries block it. */
+	long auto_commit_next;
+	long auto_commit_wait;
+
 	int on_deck;
 
 	/*
@@ -366,10 +476,19 @@ struct pda_run
 	parse_tree_t *last_final;
 
 	struct pool_alloc *parse_tree_pool;
+	struct pool_alloc *parse_ext_pool;
 	struct pool_alloc local_pool;
 
 	/* Disregard any alternate parse paths, just go right to failure. */
 	int fail_parsing;
+
+	/* Alternatives already known to fail. */
+	struct bt_memo bt_memo;
+	struct bt_stacks bt_stacks;
+
+	/* Pass committed top-level trees to the program's commit print
+	 * handler. */
+	int stream_commits;
 };
 
 void colm_pda_init( struct colm_program *prg, struct pda_run *pda_run,
@@ -379,6 +498,8 @@ void colm_pda_init( struct colm_program *prg, struct pda_run *pda_run,
 void colm_pda_clear( struct colm_program *prg, struct colm_tree **sp,
 		struct pda_run *pda_run );
 
+void colm_bt_stack_release( struct pda_run *pda_run, unsigned int stack );
+
 void colm_rt_code_vect_replace( struct rt_code_vect *vect, long pos,
 		const code_t *val, long len );
 void colm_rt_code_vect_empty( struct rt_code_vect *vect );
@@ -461,8 +582,12 @@ long colm_parse_undo_frag( struct colm_program *prg, tree_t **sp, struct pda_run
 void commit_clear_kid_list( program_t *prg, tree_t **sp, kid_t *kid );
 void commit_clear_parse_tree( program_t *prg, tree_t **sp,
 		struct pda_run *pda_run, parse_tree_t *pt );
+void commit_clear_undo( program_t *prg, tree_t **root,
+		struct pda_run *pda_run );
 void commit_reduce( program_t *prg, tree_t **root,
 		struct pda_run *pda_run );
+void commit_print( program_t *prg, tree_t **root,
+		struct pda_run *pda_run );
 
 tree_t *get_parsed_root( struct pda_run *pda_run, int stop );
 
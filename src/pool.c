@@ -186,9 +186,21 @@ parse_tree_t *parse_tree_allocate( struct pda_run *pda_run )
 
 void parse_tree_free( struct pda_run *pda_run, parse_tree_t *el )
 {
+	if ( el->stack != 0 )
+		colm_bt_stack_release( pda_run, el->stack );
+	if ( el->ext != 0 )
+		pool_alloc_free( pda_run->parse_ext_pool, el->ext );
 	pool_alloc_free( pda_run->parse_tree_pool, el );
 }
 
+/* Get the extension data, allocating it if the node doesn't have it yet. */
+parse_ext_t *parse_tree_ext( struct pda_run *pda_run, parse_tree_t *el )
+{
+	if ( el->ext == 0 )
+		el->ext = (parse_ext_t*) pool_alloc_allocate( pda_run->parse_ext_pool );
+	return el->ext;
+}
+
 void parse_tree_clear( struct pool_alloc *pool_alloc )
 {
 	pool_alloc_clear( pool_alloc );
@@ -205,7 +217,9 @@ long parse_tree_num_lost( struct pool_alloc *pool_alloc )
 
 head_t *head_allocate( program_t *prg )
 {
-	return (head_t*) pool_alloc_allocate( &prg->head_pool );
+	head_t *head = (head_t*) pool_alloc_allocate( &prg->head_pool );
+	head->refs = 1;
+	return head;
 }
 
 void head_free( program_t *prg, head_t *el )
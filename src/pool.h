@@ -51,6 +51,7 @@ parse_tree_t *parse_tree_allocate( struct pda_run *pda_run );
 void parse_tree_free( struct pda_run *pda_run, parse_tree_t *el );
 void parse_tree_clear( struct pool_alloc *pool_alloc );
 long parse_tree_num_lost( struct pool_alloc *pool_alloc );
+parse_ext_t *parse_tree_ext( struct pda_run *pda_run, parse_tree_t *el );
 
 head_t *head_allocate( program_t *prg );
 void head_free( program_t *prg, head_t *el );
@@ -33,6 +33,10 @@
 #include <colm/debug.h>
 
 #define BUFFER_INITIAL_SIZE 4096
+#define OUT_BUF_SIZE (64*1024)
+
+static const char tabs[] =
+	"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
 
 static void xml_escape_data( struct colm_print_args *print_args, const char *data, long len )
 {
@@ -97,9 +101,42 @@ void append_collect( struct colm_print_args *args, const char *data, int length
 	str_collect_append( (str_collect_t*) args->arg, data, length );
 }
 
+static void out_flush( struct stream_impl_data *impl )
+{
+	if ( impl->out_len > 0 ) {
+		fwrite( impl->out_buf, 1, impl->out_len, impl->file );
+		impl->out_len = 0;
+	}
+}
+
+static void out_write( struct stream_impl_data *impl, const char *data, long length )
+{
+	if ( impl->out_len + length > OUT_BUF_SIZE ) {
+		out_flush( impl );
+		if ( length >= OUT_BUF_SIZE ) {
+			fwrite( data, 1, length, impl->file );
+			return;
+		}
+	}
+
+	if ( impl->out_buf == 0 )
+		impl->out_buf = (char*) malloc( OUT_BUF_SIZE );
+
+	memcpy( impl->out_buf + impl->out_len, data, length );
+	impl->out_len += length;
+}
+
+static void out_indent( struct stream_impl_data *impl, int level )
+{
+	while ( level > 0 ) {
+		int n = level < (int)sizeof(tabs) - 1 ? level : (int)sizeof(tabs) - 1;
+		out_write( impl, tabs, n );
+		level -= n;
+	}
+}
+
 void append_file( struct colm_print_args *args, const char *data, int length )
 {
-	int level;
 	struct stream_impl_data *impl = (struct stream_impl_data*) args->arg;
 
 restart:
@@ -113,8 +150,7 @@ restart:
 		if ( length > 0 ) {
 			/* Found some data, print the indentation and turn off indentation
 			 * mode. */
-			for ( level = 0; level < impl->level; level++ )
-				fputc( '\t', impl->file );
+			out_indent( impl, impl->level );
 
 			impl->indent = 0;
 
@@ -128,7 +164,7 @@ restart:
 		{
 			/* Print up to and including the newline. */
 			int wl = nl - data + 1;
-			fwrite( data, 1, wl, impl->file );
+			out_write( impl, data, wl );
 
 			/* Go into consume state. If we see more non-indentation chars we
 			 * will generate the appropriate indentation level. */
@@ -139,7 +175,7 @@ restart:
 		}
 		else {
 			/* Indentation off, or no indent trigger (newline). */
-			fwrite( data, 1, length, impl->file );
+			out_write( impl, data, length );
 		}
 	}
 }
@@ -192,23 +228,109 @@ enum VisitType
 
 #define TF_TERM_SEEN 0x1
 
-void print_kid( program_t *prg, tree_t **sp, struct colm_print_args *print_args, kid_t *kid )
+/* What a descent into a kid has to restore when it returns. Child and top
+ * level frames stay in place while their kids are printed one after the
+ * other. */
+struct print_frame
 {
 	enum ReturnType rt;
+	enum VisitType visit_type;
+	kid_t *parent;
+	kid_t *kid;
+	long ignore;
+	long ignore_base;
+};
+
+#define PRINT_FRAMES 64
+#define PRINT_IGNORES 64
+
+/* Traversal stack and the ignores waiting for the next terminal. Both start
+ * out on the C stack and move to the heap only for deep trees or long runs of
+ * ignores. */
+struct print_stack
+{
+	struct print_frame *frames;
+	long frames_len;
+	long frames_alloc;
+
+	kid_t **ignores;
+	long ignores_len;
+	long ignores_alloc;
+
+	struct print_frame frames_local[PRINT_FRAMES];
+	kid_t *ignores_local[PRINT_IGNORES];
+};
+
+static void *print_stack_grow( void *data, void *local, long *alloc, long size )
+{
+	long new_alloc = *alloc * 2;
+	void *new_data;
+	if ( data == local ) {
+		new_data = malloc( new_alloc * size );
+		memcpy( new_data, data, *alloc * size );
+	}
+	else {
+		new_data = realloc( data, new_alloc * size );
+	}
+	*alloc = new_alloc;
+	return new_data;
+}
+
+static struct print_frame *print_push( struct print_stack *ps, enum ReturnType rt )
+{
+	if ( ps->frames_len == ps->frames_alloc ) {
+		ps->frames = (struct print_frame*) print_stack_grow( ps->frames,
+				ps->frames_local, &ps->frames_alloc, sizeof(struct print_frame) );
+	}
+
+	struct print_frame *frame = &ps->frames[ps->frames_len++];
+	frame->rt = rt;
+	return frame;
+}
+
+static void print_push_ignore( struct print_stack *ps, kid_t *kid )
+{
+	if ( ps->ignores_len == ps->ignores_alloc ) {
+		ps->ignores = (kid_t**) print_stack_grow( ps->ignores,
+				ps->ignores_local, &ps->ignores_alloc, sizeof(kid_t*) );
+	}
+
+	ps->ignores[ps->ignores_len++] = kid;
+}
+
+void print_kid( program_t *prg, tree_t **sp, struct colm_print_args *print_args, kid_t *kid )
+{
+	struct print_stack ps;
+	ps.frames = ps.frames_local;
+	ps.frames_len = 0;
+	ps.frames_alloc = PRINT_FRAMES;
+	ps.ignores = ps.ignores_local;
+	ps.ignores_len = 0;
+	ps.ignores_alloc = PRINT_IGNORES;
+
+	struct print_frame *frame;
 	kid_t *parent = 0;
-	kid_t *leading_ignore = 0;
 	enum VisitType visit_type;
 	int flags = 0;
 
+	/* Ignores collected since the last terminal are ignores[ignore_base]
+	 * onwards. Printing one of them starts a new list above it. */
+	long ignore_base = 0, ignore;
+
 	/* Iterate the kids passed in. We are expecting a next, which will allow us
 	 * to print the trailing ignore list. */
+	print_push( &ps, Done );
 	while ( kid != 0 ) {
-		vm_push_type( enum ReturnType, Done );
 		goto rec_call;
 		rec_return_top:
 		kid = kid->next;
 	}
+	ps.frames_len -= 1;
 
+	if ( ps.frames != ps.frames_local )
+		free( ps.frames );
+	if ( ps.ignores != ps.ignores_local )
+		free( ps.ignores );
 	return;
 
 rec_call:
@@ -218,15 +340,16 @@ rec_call:
 	/* If not currently skipping ignore data, then print it. Ignore data can
 	 * be associated with terminals and nonterminals. */
 	if ( kid->tree->flags & AF_LEFT_IGNORE ) {
-		vm_push_kid( parent );
-		vm_push_kid( kid );
+		frame = print_push( &ps, CollectIgnoreLeft );
+		frame->parent = parent;
+		frame->kid = kid;
 		parent = kid;
 		kid = tree_left_ignore_kid( prg, kid->tree );
-		vm_push_type( enum ReturnType, CollectIgnoreLeft );
 		goto rec_call;
 		rec_return_ign_left:
-		kid = vm_pop_kid();
-		parent = vm_pop_kid();
+		frame = &ps.frames[--ps.frames_len];
+		kid = frame->kid;
+		parent = frame->parent;
 	}
 
 	if ( kid->tree->id == LEL_ID_IGNORE )
@@ -242,88 +365,71 @@ rec_call:
 
 	if ( visit_type == IgnoreData ) {
 		debug( prg, REALM_PRINT, "putting %p on ignore list\n", kid->tree );
-		kid_t *new_ignore = kid_allocate( prg );
-		new_ignore->next = leading_ignore;
-		leading_ignore = new_ignore;
-		leading_ignore->tree = kid->tree;
+		print_push_ignore( &ps, kid );
 		goto skip_node;
 	}
 
 	if ( visit_type == IgnoreWrapper ) {
-		kid_t *new_ignore = kid_allocate( prg );
-		new_ignore->next = leading_ignore;
-		leading_ignore = new_ignore;
-		leading_ignore->tree = kid->tree;
+		print_push_ignore( &ps, kid );
 		/* Don't skip. */
 	}
 
 	/* print leading ignore? Triggered by terminals. */
-	if ( visit_type == Term ) {
-		/* Reverse the leading ignore list. */
-		if ( leading_ignore != 0 ) {
-			kid_t *ignore = 0, *last = 0;
-
-			/* Reverse the list and take the opportunity to implement the
-			 * suppress left. */
-			while ( true ) {
-				kid_t *next = leading_ignore->next;
-				leading_ignore->next = last;
-
-				if ( leading_ignore->tree->flags & AF_SUPPRESS_LEFT ) {
-					/* We are moving left. Chop off the tail. */
-					debug( prg, REALM_PRINT, "suppressing left\n" );
-					free_kid_list( prg, next );
-					break;
-				}
+	if ( visit_type == Term && ps.ignores_len > ignore_base ) {
+		/* Implement the suppress left. Printing starts at the last ignore
+		 * that suppresses what comes before it. */
+		ignore = ps.ignores_len - 1;
+		while ( ignore > ignore_base ) {
+			if ( ps.ignores[ignore]->tree->flags & AF_SUPPRESS_LEFT ) {
+				debug( prg, REALM_PRINT, "suppressing left\n" );
+				break;
+			}
+			ignore -= 1;
+		}
 
-				if ( next == 0 )
+		/* Print the leading ignores. Also implement the suppress right in the
+		 * process. */
+		if ( print_args->comm && (!print_args->trim ||
+				(flags & TF_TERM_SEEN && kid->tree->id > 0)) )
+		{
+			while ( ignore < ps.ignores_len ) {
+				kid_t *ign = ps.ignores[ignore];
+				if ( ign->tree->flags & AF_SUPPRESS_RIGHT )
 					break;
 
-				last = leading_ignore;
-				leading_ignore = next;
-			}
-
-			/* Print the leading ignore list. Also implement the suppress right
-			 * in the process. */
-			if ( print_args->comm && (!print_args->trim ||
-					(flags & TF_TERM_SEEN && kid->tree->id > 0)) )
-			{
-				ignore = leading_ignore;
-				while ( ignore != 0 ) {
-					if ( ignore->tree->flags & AF_SUPPRESS_RIGHT )
-						break;
-
-					if ( ignore->tree->id != LEL_ID_IGNORE ) {
-						vm_push_type( enum VisitType, visit_type );
-						vm_push_kid( leading_ignore );
-						vm_push_kid( ignore );
-						vm_push_kid( parent );
-						vm_push_kid( kid );
-
-						leading_ignore = 0;
-						kid = ignore;
-						parent = 0;
-
-						debug( prg, REALM_PRINT, "rec call on %p\n", kid->tree );
-						vm_push_type( enum ReturnType, RecIgnoreList );
-						goto rec_call;
-						rec_return_il:
-
-						kid = vm_pop_kid();
-						parent = vm_pop_kid();
-						ignore = vm_pop_kid();
-						leading_ignore = vm_pop_kid();
-						visit_type = vm_pop_type(enum VisitType);
-					}
-
-					ignore = ignore->next;
+				if ( ign->tree->id != LEL_ID_IGNORE ) {
+					frame = print_push( &ps, RecIgnoreList );
+					frame->visit_type = visit_type;
+					frame->parent = parent;
+					frame->kid = kid;
+					frame->ignore = ignore;
+					frame->ignore_base = ignore_base;
+
+					ignore_base = ps.ignores_len;
+					kid = ign;
+					parent = 0;
+
+					debug( prg, REALM_PRINT, "rec call on %p\n", kid->tree );
+					goto rec_call;
+					rec_return_il:
+
+					/* Drop what the ignore left uncollected. */
+					ps.ignores_len = ignore_base;
+
+					frame = &ps.frames[--ps.frames_len];
+					kid = frame->kid;
+					parent = frame->parent;
+					ignore = frame->ignore;
+					ignore_base = frame->ignore_base;
+					visit_type = frame->visit_type;
 				}
-			}
 
-			/* Free the leading ignore list. */
-			free_kid_list( prg, leading_ignore );
-			leading_ignore = 0;
+				ignore += 1;
+			}
 		}
+
+		/* Done with the leading ignores. */
+		ps.ignores_len = ignore_base;
 	}
 
 	if ( visit_type == Term || visit_type == NonTerm ) {
@@ -349,20 +455,21 @@ rec_call:
 		tree_child( prg, kid->tree );
 
 	if ( child != 0 ) {
-		vm_push_type( enum VisitType, visit_type );
-		vm_push_kid( parent );
-		vm_push_kid( kid );
+		frame = print_push( &ps, ChildPrint );
+		frame->visit_type = visit_type;
+		frame->parent = parent;
+		frame->kid = kid;
 		parent = kid;
 		kid = child;
 		while ( kid != 0 ) {
-			vm_push_type( enum ReturnType, ChildPrint );
 			goto rec_call;
 			rec_return:
 			kid = kid->next;
 		}
-		kid = vm_pop_kid();
-		parent = vm_pop_kid();
-		visit_type = vm_pop_type(enum VisitType);
+		frame = &ps.frames[--ps.frames_len];
+		kid = frame->kid;
+		parent = frame->parent;
+		visit_type = frame->visit_type;
 	}
 
 	if ( visit_type == Term || visit_type == NonTerm ) {
@@ -376,22 +483,23 @@ skip_node:
 	 * be associated with terminals and nonterminals. */
 	if ( kid->tree->flags & AF_RIGHT_IGNORE ) {
 		debug( prg, REALM_PRINT, "right ignore\n" );
-		vm_push_kid( parent );
-		vm_push_kid( kid );
+		frame = print_push( &ps, CollectIgnoreRight );
+		frame->parent = parent;
+		frame->kid = kid;
 		parent = kid;
 		kid = tree_right_ignore_kid( prg, kid->tree );
-		vm_push_type( enum ReturnType, CollectIgnoreRight );
 		goto rec_call;
 		rec_return_ign_right:
-		kid = vm_pop_kid();
-		parent = vm_pop_kid();
+		frame = &ps.frames[--ps.frames_len];
+		kid = frame->kid;
+		parent = frame->parent;
 	}
 
 /* For skiping over content on null. */
 skip_null:
 
-	rt = vm_pop_type(enum ReturnType);
-	switch ( rt ) {
+	/* Child and top level frames are popped by their loops. */
+	switch ( ps.frames[ps.frames_len - 1].rt ) {
 		case Done:
 			debug( prg, REALM_PRINT, "return: done\n" );
 			goto rec_return_top;
@@ -515,6 +623,7 @@ void colm_print_tree_file( program_t *prg, tree_t **sp, struct stream_impl *impl
 	};
 
 	colm_print_tree_args( prg, sp, &print_args, tree );
+	out_flush( (struct stream_impl_data*)impl );
 }
 
 static void xml_open( program_t *prg, tree_t **sp, struct colm_print_args *args,
@@ -597,6 +706,7 @@ void colm_print_xml_stdout( program_t *prg, tree_t **sp,
 			impl, comm_attr, comm_attr, trim, &append_file, 
 			&xml_open, &xml_term, &xml_close };
 	colm_print_tree_args( prg, sp, &print_args, tree );
+	out_flush( (struct stream_impl_data*)impl );
 }
 
 static void postfix_open( program_t *prg, tree_t **sp, struct colm_print_args *args,
@@ -175,6 +175,55 @@ void colm_set_reduce_clean( struct colm_program *prg, unsigned char reduce_clean
 	prg->reduce_clean = reduce_clean;
 }
 
+void colm_set_auto_commit( struct colm_program *prg, long tokens )
+{
+	prg->auto_commit = tokens > 0 ? tokens : 0;
+}
+
+void colm_set_iter_index( struct colm_program *prg, unsigned char iter_index )
+{
+	prg->iter_index = iter_index;
+}
+
+void colm_set_tree_hash( struct colm_program *prg, unsigned char tree_hash )
+{
+	prg->tree_hash = tree_hash;
+}
+
+void colm_set_share_tokens( struct colm_program *prg, unsigned char share_tokens )
+{
+	prg->share_tokens = share_tokens;
+}
+
+void colm_set_read_ahead( struct colm_program *prg, unsigned char read_ahead )
+{
+	prg->read_ahead = read_ahead;
+}
+
+void colm_set_commit_print( struct colm_program *prg,
+		colm_commit_print_t commit_print, void *arg )
+{
+	prg->commit_print = commit_print;
+	prg->commit_print_arg = arg;
+}
+
+/* Memoizing failed alternatives relies on the parse being a function of
+ * the stack and the input alone. Token generation and reduction actions can
+ * read and write program state, so any of them turns it off. */
+static int bt_memo_safe( struct colm_sections *rtd )
+{
+	long i;
+	for ( i = 0; i < rtd->num_prods; i++ ) {
+		if ( rtd->prod_info[i].frame_id >= 0 )
+			return 0;
+	}
+	for ( i = 0; i < rtd->num_lang_els; i++ ) {
+		if ( rtd->lel_info[i].frame_id >= 0 )
+			return 0;
+	}
+	return 1;
+}
+
 program_t *colm_new_program( struct colm_sections *rtd )
 {
 	program_t *prg = malloc(sizeof(program_t));
@@ -186,10 +235,12 @@ program_t *colm_new_program( struct colm_sections *rtd )
 	prg->rtd = rtd;
 	prg->ctx_dep_parsing = 1;
 	prg->reduce_clean = 1;
+	prg->bt_memo = bt_memo_safe( rtd );
 
 	init_pool_alloc( &prg->kid_pool, sizeof(kid_t) );
 	init_pool_alloc( &prg->tree_pool, sizeof(tree_t) );
 	init_pool_alloc( &prg->parse_tree_pool, sizeof(parse_tree_t) );
+	init_pool_alloc( &prg->parse_ext_pool, sizeof(parse_ext_t) );
 	init_pool_alloc( &prg->head_pool, sizeof(head_t) );
 	init_pool_alloc( &prg->location_pool, sizeof(location_t) );
 
@@ -282,11 +333,13 @@ int colm_delete_program( program_t *prg )
 	colm_clear_heap( prg, sp );
 
 	colm_tree_downref( prg, sp, prg->error );
+	colm_tree_index_clear( prg, sp );
 
 #if DEBUG
 	long kid_lost = kid_num_lost( prg );
 	long tree_lost = tree_num_lost( prg );
 	long parse_tree_lost = parse_tree_num_lost( &prg->parse_tree_pool );
+	long parse_ext_lost = pool_alloc_num_lost( &prg->parse_ext_pool );
 	long head_lost = head_num_lost( prg );
 	long location_lost = location_num_lost( prg );
 
@@ -299,6 +352,9 @@ int colm_delete_program( program_t *prg )
 	if ( parse_tree_lost )
 		message( "warning: lost parse trees: %ld\n", parse_tree_lost );
 
+	if ( parse_ext_lost )
+		message( "warning: lost parse tree extensions: %ld\n", parse_ext_lost );
+
 	if ( head_lost )
 		message( "warning: lost heads: %ld\n", head_lost );
 
@@ -310,6 +366,7 @@ int colm_delete_program( program_t *prg )
 	tree_clear( prg );
 	head_clear( prg );
 	parse_tree_clear( &prg->parse_tree_pool );
+	pool_alloc_clear( &prg->parse_ext_pool );
 	location_clear( prg );
 
 	struct run_buf *rb = prg->alloc_run_buf;
@@ -319,6 +376,18 @@ int colm_delete_program( program_t *prg )
 		rb = next;
 	}
 
+	int c;
+	for ( c = 0; c < RUN_BUF_CLASSES; c++ ) {
+		rb = prg->run_buf_pool[c];
+		while ( rb != 0 ) {
+			struct run_buf *next = rb->next;
+			free( rb );
+			rb = next;
+		}
+	}
+
+	colm_release_mappings( prg );
+
 	vm_clear( prg );
 
 	if ( prg->stream_fns ) {
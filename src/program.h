@@ -119,6 +119,7 @@ struct colm_sections
 	int (*reducer_need_tok)( program_t *prg, struct pda_run *pda_run, int id );
 	int (*reducer_need_ign)( program_t *prg, struct pda_run *pda_run );
 	void (*read_reduce)( program_t *prg, int reducer, input_t *input );
+	int (*match_pattern)( program_t *prg, long pattern_id, tree_t **bindings, kid_t *kid );
 };
 
 struct heap_list
@@ -137,6 +138,35 @@ struct colm_program
 
 	unsigned char ctx_dep_parsing;
 	unsigned char reduce_clean;
+
+	/* Failed alternatives can be memoized. Only true when no code runs
+	 * during the parse. */
+	unsigned char bt_memo;
+
+	/* Commit automatically after this many shifted tokens, once there are
+	 * no retry points left to return to. Zero turns it off. */
+	long auto_commit;
+
+	/* Index trees for typed iteration. Most recently used first. */
+	unsigned char iter_index;
+	struct tree_index *index_head, *index_tail;
+	long index_count;
+	struct tree_index_seen index_seen[TREE_INDEX_SEEN];
+	long index_seen_next;
+
+	/* Use cached structural hashes to settle tree inequality. */
+	unsigned char tree_hash;
+
+	/* Share identical tokens in parse results. */
+	unsigned char share_tokens;
+
+	/* Read pipes and other unmapped input files on a helper thread. */
+	unsigned char read_ahead;
+
+	/* Receives committed top-level trees of parses of stdin. */
+	colm_commit_print_t commit_print;
+	void *commit_print_arg;
+
 	struct colm_sections *rtd;
 	struct colm_struct *global;
 	int induce_exit;
@@ -145,6 +175,7 @@ struct colm_program
 	struct pool_alloc kid_pool;
 	struct pool_alloc tree_pool;
 	struct pool_alloc parse_tree_pool;
+	struct pool_alloc parse_ext_pool;
 	struct pool_alloc head_pool;
 	struct pool_alloc location_pool;
 
@@ -161,6 +192,14 @@ struct colm_program
 
 	struct run_buf *alloc_run_buf;
 
+	/* Unreferenced run buffers ready for reuse, by size class. */
+	struct run_buf *run_buf_pool[RUN_BUF_CLASSES];
+	int run_buf_pool_len[RUN_BUF_CLASSES];
+
+	/* Files mapped by input streams. Token data points into them, so they
+	 * stay mapped until the program is deleted. */
+	struct stream_mapping *mappings;
+
 	/* Current stack block limits. Changed when crossing block boundaries. */
 	tree_t **sb_beg;
 	tree_t **sb_end;
@@ -214,6 +214,36 @@ void RedFsm::sortByStateId()
 	delete[] ptrList;
 }
 
+struct CmpStateByProfile
+{
+	static int compare( RedState *st1, RedState *st2 )
+	{
+		if ( st1->profVisits > st2->profVisits )
+			return -1;
+		else if ( st1->profVisits < st2->profVisits )
+			return 1;
+		else
+			return 0;
+	}
+};
+
+void RedFsm::sortByProfile()
+{
+	int pos = 0;
+	RedState **ptrList = new RedState*[stateList.length()];
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ )
+		ptrList[pos++] = st;
+	
+	MergeSort<RedState*, CmpStateByProfile> mergeSort;
+	mergeSort.sort( ptrList, stateList.length() );
+
+	stateList.abandon();
+	for ( int st = 0; st < pos; st++ )
+		stateList.append( ptrList[st] );
+
+	delete[] ptrList;
+}
+
 /* Find the final state with the lowest id. */
 void RedFsm::findFirstFinState()
 {
@@ -274,7 +274,9 @@ struct RedState
 		bAnyRegCurStateRef(false),
 		partitionBoundary(false),
 		inTrans(0),
-		numInTrans(0)
+		numInTrans(0),
+		profVisits(0),
+		profRangeOff(0)
 	{ }
 
 	/* Transitions out. */
@@ -313,6 +315,13 @@ struct RedState
 
 	RedTrans **inTrans;
 	int numInTrans;
+
+	/* Scanner profile data. Visit count and hits for each range, indexed
+	 * parallel to outRange. The offset locates this state's ranges in the
+	 * generated counter array. */
+	unsigned long profVisits;
+	Vector<unsigned long> profRangeHits;
+	int profRangeOff;
 };
 
 /* List of states. */
@@ -448,6 +457,10 @@ struct RedFsm
 	/* Sorting states by id. */
 	void sortByStateId();
 
+	/* Move states with the most recorded visits to the front. This is a
+	 * stable sort. */
+	void sortByProfile();
+
 	/* Locating the first final state. This is the final state with the lowest
 	 * id. */
 	void findFirstFinState();
@@ -295,11 +295,14 @@ UniqueType *TypeRef::resolveTypeMap( Compiler *pd )
 	if ( !mapEl )
 		error( loc ) << "could not find map element in type ref" << endp;
 
-	UniqueGeneric *inMap = 0, searchKey( UniqueGeneric::Map, utKey, utEl );
+	/* The hashmap uses the same element as the map. */
+	UniqueGeneric *inMap = 0, searchKey( type == HashMap ?
+			UniqueGeneric::HashMap : UniqueGeneric::Map, utKey, utEl );
 
 	if ( uniqueGeneric( inMap, pd, searchKey ) ) {
 
-		GenericType *generic = new GenericType( GEN_MAP,
+		GenericType *generic = new GenericType(
+				type == HashMap ? GEN_HASHMAP : GEN_MAP,
 				pd->nextGenericId++, typeRef2, typeRef1, typeRef3, mapEl );
 
 		nspace->genericList.append( generic );
@@ -335,6 +338,27 @@ UniqueType *TypeRef::resolveTypeParser( Compiler *pd )
 	return pd->findUniqueType( TYPE_GENERIC, inMap->generic );
 }
 
+UniqueType *TypeRef::resolveTypeVector( Compiler *pd )
+{
+	nspace = pd->rootNamespace;
+
+	UniqueType *utValue = typeRef1->resolveType( pd );	
+
+	UniqueGeneric *inMap = 0, searchKey( UniqueGeneric::Vector, utValue );
+	if ( uniqueGeneric( inMap, pd, searchKey ) ) {
+		GenericType *generic = new GenericType( GEN_VECTOR,
+				pd->nextGenericId++, typeRef1, 0, typeRef1, 0 );
+
+		nspace->genericList.append( generic );
+
+		generic->declare( pd, nspace );
+
+		inMap->generic = generic;
+	}
+
+	generic = inMap->generic;
+	return pd->findUniqueType( TYPE_GENERIC, inMap->generic );
+}
 
 /*
  * End object based list/map
@@ -432,6 +456,9 @@ UniqueType *TypeRef::resolveType( Compiler *pd )
 		case Parser:
 			uniqueType = resolveTypeParser( pd );
 			break;
+		case Vector:
+			uniqueType = resolveTypeVector( pd );
+			break;
 		case Ref:
 			uniqueType = resolveTypeRef( pd );
 			break;
@@ -450,6 +477,7 @@ UniqueType *TypeRef::resolveType( Compiler *pd )
 			break;
 
 		case Map:
+		case HashMap:
 			uniqueType = resolveTypeMap( pd );
 			break;
 		case MapPtrs:
@@ -28,6 +28,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include <colm/pdarun.h>
 #include <colm/debug.h>
@@ -37,38 +38,63 @@
 #include <colm/pool.h>
 #include <colm/struct.h>
 
+#include "config.h"
+
+#if defined(HAVE_SYS_MMAN_H)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#endif
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+#define STREAM_DECOMPRESS
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_LIBZ)
+#include <zlib.h>
+#endif
+
+#if defined(HAVE_LIBZSTD)
+#include <zstd.h>
+#endif
+
 DEF_STREAM_FUNCS( stream_funcs_data, stream_impl_data );
 
 extern struct stream_funcs_data file_funcs;
 extern struct stream_funcs_data accum_funcs;
+extern struct stream_funcs_data mmap_funcs;
+extern struct stream_funcs_data decompress_funcs;
 
 void stream_impl_push_line( struct stream_impl_data *ss, int ll )
 {
-	if ( ss->line_len == 0 ) {
-		ss->lines_cur = 0;
-		ss->lines_alloc = 16;
-		ss->line_len = malloc( sizeof(int) * ss->lines_alloc );
-	}
-	else if ( ss->lines_cur == ss->lines_alloc ) {
-		int lines_alloc_new = ss->lines_alloc * 2;
-		int *line_len_new = malloc( sizeof(int) * lines_alloc_new );
-		memcpy( line_len_new, ss->line_len, sizeof(int) * ss->lines_alloc );
-		ss->lines_alloc = lines_alloc_new;
-		ss->line_len = line_len_new;
-	}
+	if ( ss->line_len == 0 )
+		ss->line_len = malloc( sizeof(int) * LINE_LEN_HISTORY );
 
-	ss->line_len[ ss->lines_cur ] = ll;
-	ss->lines_cur += 1;
+	ss->line_len[ss->lines_head] = ll;
+	ss->lines_head = ( ss->lines_head + 1 ) % LINE_LEN_HISTORY;
+	if ( ss->lines_cur < LINE_LEN_HISTORY )
+		ss->lines_cur += 1;
 }
 
-int stream_impl_pop_line( struct stream_impl_data *ss )
+/* Drops the last n lines and returns the column of the newline ending the
+ * first of them, or -1 if it is no longer in the history. */
+int stream_impl_pop_lines( struct stream_impl_data *ss, long n )
 {
-	int len = 0;
-	if ( ss->lines_cur > 0 ) {
-		ss->lines_cur -= 1;
-		len = ss->line_len[ss->lines_cur];
+	if ( n > ss->lines_cur ) {
+		ss->lines_cur = 0;
+		return -1;
 	}
-	return len;
+
+	ss->lines_head = ( ss->lines_head + LINE_LEN_HISTORY - n ) % LINE_LEN_HISTORY;
+	ss->lines_cur -= n;
+	return ss->line_len[ss->lines_head];
 }
 
 static void dump_contents( struct colm_program *prg, struct stream_impl_data *sid )
@@ -150,52 +176,124 @@ static struct run_buf *si_data_pop_head( struct stream_impl_data *ss )
 }
 
 
-struct run_buf *new_run_buf( int sz )
+/* The smallest run buffer size that holds sz bytes. Past RUN_BUF_MAX it is sz
+ * itself. */
+static long run_buf_size( long sz )
+{
+	long size = FSM_BUFSIZE;
+	while ( size < sz && size < RUN_BUF_MAX )
+		size <<= 1;
+	return size < sz ? sz : size;
+}
+
+/* Pool slot for buffers of the given size, or -1 if they are not pooled. */
+static int run_buf_class( long size )
+{
+	int c;
+	for ( c = 0; c < RUN_BUF_CLASSES; c++ ) {
+		if ( size == ( FSM_BUFSIZE << c ) )
+			return c;
+	}
+	return -1;
+}
+
+/* Allocates a buffer for at least sz bytes, from the program's pool if it has
+ * one. Without a program it is always a fresh allocation. The data is left
+ * uninitialized. */
+struct run_buf *new_run_buf( struct colm_program *prg, long sz )
 {
+	long size = run_buf_size( sz );
+	int c = run_buf_class( size );
+
 	struct run_buf *rb;
-	if ( sz > FSM_BUFSIZE ) {
-		int ssz = sizeof(struct run_buf) + sz - FSM_BUFSIZE;
-		rb = (struct run_buf*) malloc( ssz );
-		memset( rb, 0, ssz );
+	if ( prg != 0 && c >= 0 && prg->run_buf_pool[c] != 0 ) {
+		rb = prg->run_buf_pool[c];
+		prg->run_buf_pool[c] = rb->next;
+		prg->run_buf_pool_len[c] -= 1;
 	}
 	else {
-		rb = (struct run_buf*) malloc( sizeof(struct run_buf) );
-		memset( rb, 0, sizeof(struct run_buf) );
+		rb = (struct run_buf*) malloc( sizeof(struct run_buf) + size - FSM_BUFSIZE );
 	}
+
+	rb->length = 0;
+	rb->offset = 0;
+	rb->size = size;
+	rb->next = rb->prev = 0;
+	rb->referenced = 0;
 	return rb;
 }
 
+void free_run_buf( struct colm_program *prg, struct run_buf *rb )
+{
+	int c = run_buf_class( rb->size );
+	if ( c >= 0 && prg->run_buf_pool_len[c] < RUN_BUF_POOL_MAX ) {
+		rb->next = prg->run_buf_pool[c];
+		prg->run_buf_pool[c] = rb;
+		prg->run_buf_pool_len[c] += 1;
+	}
+	else {
+		free( rb );
+	}
+}
+
+/* Buffers that token data points into go to the program, which frees them
+ * when it is deleted. */
+static void release_run_buf( struct colm_program *prg, struct run_buf *run_buf )
+{
+	if ( run_buf->referenced ) {
+		run_buf->next = prg->alloc_run_buf;
+		prg->alloc_run_buf = run_buf;
+	}
+	else {
+		free_run_buf( prg, run_buf );
+	}
+}
+
 /* Keep the position up to date after consuming text. */
 void update_position_data( struct stream_impl_data *is, const char *data, long length )
 {
-	int i;
-	for ( i = 0; i < length; i++ ) {
-		if ( data[i] == '\n' ) {
-			stream_impl_push_line( is, is->column );
-			is->line += 1;
-			is->column = 1;
-		}
-		else {
-			is->column += 1;
-		}
+	const char *p = data, *end = data + length, *nl;
+	while ( p < end && ( nl = memchr( p, '\n', end - p ) ) != 0 ) {
+		is->column += nl - p;
+		stream_impl_push_line( is, is->column );
+		is->line += 1;
+		is->column = 1;
+		p = nl + 1;
 	}
 
+	is->column += end - p;
 	is->byte += length;
 }
 
-/* Keep the position up to date after sending back text. */
-void undo_position_data( struct stream_impl_data *is, const char *data, long length )
+/* Keep the position up to date after sending back text. The prefix is
+ * whatever the caller still holds of the text preceding data. It gives the
+ * column if the line history does not reach back far enough. */
+void undo_position_data( struct stream_impl_data *is, const char *data, long length,
+		const char *prefix, long prefix_len )
 {
-	/* FIXME: this needs to fetch the position information from the parsed
-	 * token and restore based on that.. */
-	int i;
-	for ( i = 0; i < length; i++ ) {
-		if ( data[i] == '\n' ) {
-			is->line -= 1;
-			is->column = stream_impl_pop_line( is );
+	const char *first = memchr( data, '\n', length );
+	if ( first == 0 ) {
+		is->column -= length;
+	}
+	else {
+		long lines = 1;
+		const char *p = first + 1, *end = data + length, *nl;
+		while ( p < end && ( nl = memchr( p, '\n', end - p ) ) != 0 ) {
+			lines += 1;
+			p = nl + 1;
+		}
+
+		is->line -= lines;
+
+		int column = stream_impl_pop_lines( is, lines );
+		if ( column >= 0 ) {
+			is->column = column - ( first - data );
 		}
 		else {
-			is->column -= 1;
+			long back = 0;
+			while ( back < prefix_len && prefix[prefix_len - back - 1] != '\n' )
+				back += 1;
+			is->column = back + 1;
 		}
 	}
 
@@ -215,10 +313,275 @@ static void data_transfer_loc( struct colm_program *prg, location_t *loc, struct
 	loc->byte = ss->byte;
 }
 
+#if defined(HAVE_PTHREAD_H)
+/*
+ * Read-ahead. A helper thread reads the file into run buffers and hands them
+ * to the stream through a ring of READ_AHEAD_BUFS slots. The buffers are
+ * larger than usual so that handing one over is rare next to reading it. The thread is the
+ * only writer of tail and the stream the only writer of head.
+ */
+
+#define READ_AHEAD_BUFS 2
+#define READ_AHEAD_BUFSIZE (64*1024)
+
+struct read_ahead
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int fd;
+
+	struct run_buf *ring[READ_AHEAD_BUFS];
+	long head;
+	long tail;
+
+	/* Buffer being read into. Freed by the stream if the thread is
+	 * cancelled in the read. */
+	struct run_buf *filling;
+
+	char eof;
+	char stop;
+};
+
+static void *read_ahead_thread( void *arg )
+{
+	struct read_ahead *ra = (struct read_ahead*)arg;
+
+	/* Cancellation only takes place inside the read, which may block on a
+	 * pipe for as long as the writer likes. */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, 0 );
+
+	while ( true ) {
+		ra->filling = new_run_buf( 0, READ_AHEAD_BUFSIZE );
+		/* Allocated past the declared size of data. */
+		char *dest = (char*)ra->filling + offsetof( struct run_buf, data );
+
+		pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, 0 );
+		ssize_t received = read( ra->fd, dest, READ_AHEAD_BUFSIZE );
+		pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, 0 );
+
+		if ( received < 0 && errno == EINTR ) {
+			free( ra->filling );
+			continue;
+		}
+
+		pthread_mutex_lock( &ra->mutex );
+
+		if ( received <= 0 ) {
+			ra->eof = true;
+			pthread_cond_signal( &ra->cond );
+			pthread_mutex_unlock( &ra->mutex );
+			break;
+		}
+
+		ra->filling->length = received;
+		while ( ra->tail - ra->head == READ_AHEAD_BUFS && !ra->stop )
+			pthread_cond_wait( &ra->cond, &ra->mutex );
+
+		if ( ra->stop ) {
+			pthread_mutex_unlock( &ra->mutex );
+			break;
+		}
+
+		ra->ring[ra->tail % READ_AHEAD_BUFS] = ra->filling;
+		ra->filling = 0;
+		ra->tail += 1;
+		pthread_cond_signal( &ra->cond );
+		pthread_mutex_unlock( &ra->mutex );
+	}
+
+	free( ra->filling );
+	ra->filling = 0;
+	return 0;
+}
+
+/* Takes the next filled buffer, waiting for the thread if there is none yet.
+ * Returns zero at the end of the file. */
+static struct run_buf *read_ahead_take( struct read_ahead *ra )
+{
+	struct run_buf *buf = 0;
+
+	pthread_mutex_lock( &ra->mutex );
+	while ( ra->head == ra->tail && !ra->eof )
+		pthread_cond_wait( &ra->cond, &ra->mutex );
+
+	if ( ra->head != ra->tail ) {
+		buf = ra->ring[ra->head % READ_AHEAD_BUFS];
+		ra->head += 1;
+		pthread_cond_signal( &ra->cond );
+	}
+	pthread_mutex_unlock( &ra->mutex );
+
+	return buf;
+}
+
+static void read_ahead_start( struct colm_program *prg, struct stream_impl_data *si )
+{
+	if ( !prg->read_ahead )
+		return;
+
+	struct read_ahead *ra = (struct read_ahead*)malloc( sizeof(struct read_ahead) );
+	memset( ra, 0, sizeof(struct read_ahead) );
+	ra->fd = fileno( si->file );
+	pthread_mutex_init( &ra->mutex, 0 );
+	pthread_cond_init( &ra->cond, 0 );
+
+	/* Signals stay with the program's own thread. */
+	sigset_t all, old;
+	sigfillset( &all );
+	pthread_sigmask( SIG_SETMASK, &all, &old );
+	int res = pthread_create( &ra->thread, 0, &read_ahead_thread, ra );
+	pthread_sigmask( SIG_SETMASK, &old, 0 );
+
+	if ( res != 0 ) {
+		pthread_cond_destroy( &ra->cond );
+		pthread_mutex_destroy( &ra->mutex );
+		free( ra );
+		return;
+	}
+
+	si->read_ahead = ra;
+}
+
+/* Stops the thread and drops what it read that was not taken. Must come
+ * before the file is closed. */
+static void read_ahead_stop( struct colm_program *prg, struct stream_impl_data *si )
+{
+	struct read_ahead *ra = si->read_ahead;
+	if ( ra == 0 )
+		return;
+
+	pthread_mutex_lock( &ra->mutex );
+	ra->stop = true;
+	pthread_cond_signal( &ra->cond );
+	pthread_mutex_unlock( &ra->mutex );
+
+	pthread_cancel( ra->thread );
+	pthread_join( ra->thread, 0 );
+
+	while ( ra->head != ra->tail ) {
+		free( ra->ring[ra->head % READ_AHEAD_BUFS] );
+		ra->head += 1;
+	}
+	free( ra->filling );
+
+	pthread_cond_destroy( &ra->cond );
+	pthread_mutex_destroy( &ra->mutex );
+	free( ra );
+	si->read_ahead = 0;
+}
+
+#else
+
+static void read_ahead_start( struct colm_program *prg, struct stream_impl_data *si ) {}
+static void read_ahead_stop( struct colm_program *prg, struct stream_impl_data *si ) {}
+
+#endif
+
+#if defined(STREAM_DECOMPRESS)
+/*
+ * Compressed file state. The file is read in blocks of COMPRESSED_BUFSIZE
+ * and decoded straight into run buffers of the same size.
+ */
+
+#define COMPRESSED_BUFSIZE (64*1024)
+
+enum compression
+{
+	COMPRESS_NONE = 0,
+	COMPRESS_GZIP,
+	COMPRESS_ZSTD
+};
+
+struct decompress
+{
+	int fd;
+	enum compression kind;
+
+	unsigned char *in;
+	long in_len;
+	long in_pos;
+	char in_eof;
+
+	/* Hit the end of the data or a decoding error. */
+	char done;
+
+#if defined(HAVE_LIBZ)
+	z_stream z;
+#endif
+#if defined(HAVE_LIBZSTD)
+	ZSTD_DStream *zstd;
+#endif
+};
+
+static void decompress_end( struct colm_program *prg, struct stream_impl_data *si )
+{
+	struct decompress *dc = si->decompress;
+	if ( dc == 0 )
+		return;
+
+#if defined(HAVE_LIBZ)
+	if ( dc->kind == COMPRESS_GZIP )
+		inflateEnd( &dc->z );
+#endif
+#if defined(HAVE_LIBZSTD)
+	if ( dc->kind == COMPRESS_ZSTD )
+		ZSTD_freeDStream( dc->zstd );
+#endif
+
+	close( dc->fd );
+	free( dc->in );
+	free( dc );
+	si->decompress = 0;
+}
+
+#else
+
+static void decompress_end( struct colm_program *prg, struct stream_impl_data *si ) {}
+
+#endif
+
 /*
  * Data inputs: files, strings, etc.
  */
 
+/* Reads the next buffer of source data. Returns zero at the end. */
+static struct run_buf *data_source_buf( struct colm_program *prg, struct stream_impl_data *ss )
+{
+#if defined(HAVE_PTHREAD_H)
+	if ( ss->read_ahead != 0 )
+		return read_ahead_take( ss->read_ahead );
+#endif
+
+	long size = ss->bufsize > 0 ? ss->bufsize : FSM_BUFSIZE;
+	struct run_buf *run_buf = new_run_buf( prg, size );
+	int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, size );
+	if ( received == 0 ) {
+		free_run_buf( prg, run_buf );
+		return 0;
+	}
+
+	if ( received == size ) {
+		/* The source keeps ahead of the scanner. Read it in larger blocks. */
+		if ( size < RUN_BUF_MAX )
+			ss->bufsize = size * 2;
+	}
+	else {
+		/* Back off. Token data may keep the buffer alive for the rest of the
+		 * program, so give up the space that was not used. */
+		long fit = run_buf_size( received );
+		ss->bufsize = fit;
+		if ( fit < size ) {
+			run_buf = (struct run_buf*) realloc( run_buf,
+					sizeof(struct run_buf) + fit - FSM_BUFSIZE );
+			run_buf->size = fit;
+		}
+	}
+
+	run_buf->length = received;
+	return run_buf;
+}
+
 static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss, char *dest, int length )
 {
 	int copied = 0;
@@ -228,14 +591,10 @@ static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss,
 	while ( true ) {
 		if ( buf == 0 ) {
 			/* Got through the in-mem buffers without copying anything. */
-			struct run_buf *run_buf = new_run_buf( 0 );
-			int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, FSM_BUFSIZE );
-			if ( received == 0 ) {
-				free( run_buf );
+			struct run_buf *run_buf = data_source_buf( prg, ss );
+			if ( run_buf == 0 )
 				break;
-			}
 
-			run_buf->length = received;
 			si_data_push_tail( ss, run_buf );
 
 			buf = run_buf;
@@ -265,6 +624,27 @@ static int data_get_data( struct colm_program *prg, struct stream_impl_data *ss,
 	return copied;
 }
 
+/* Hands out the next length bytes in place if they lie in one buffer. The
+ * scanner has seen all of them, so no source data needs to be read. */
+static int data_get_data_pointer( struct colm_program *prg, struct stream_impl_data *ss, const char **pdp, int length )
+{
+	struct run_buf *buf = ss->queue.head;
+	while ( buf != 0 && buf->offset == buf->length )
+		buf = buf->next;
+
+	if ( buf == 0 )
+		return 0;
+
+	long avail = buf->length - buf->offset;
+	if ( avail >= length ) {
+		buf->referenced = 1;
+		avail = length;
+	}
+
+	*pdp = buf->data + buf->offset;
+	return avail;
+}
+
 static struct stream_impl *data_split_consumed( program_t *prg, struct stream_impl_data *sid )
 {
 	struct stream_impl *split_off = 0;
@@ -279,9 +659,9 @@ static struct stream_impl *data_split_consumed( program_t *prg, struct stream_im
 int data_append_data( struct colm_program *prg, struct stream_impl_data *sid, const char *data, int length )
 {
 	struct run_buf *tail = sid->queue.tail;
-	if ( tail == 0 || length > (FSM_BUFSIZE - tail->length) ) {
+	if ( tail == 0 || length > (tail->size - tail->length) ) {
 		debug( prg, REALM_INPUT, "data_append_data: allocating run buf\n" );
-		tail = new_run_buf( length );
+		tail = new_run_buf( prg, length );
 		si_data_push_tail( sid, tail );
 	}
 
@@ -326,7 +706,7 @@ int data_undo_append_data( struct colm_program *prg, struct stream_impl_data *si
 			break;
 
 		struct run_buf *run_buf = si_data_pop_tail( sid );
-		free( run_buf );
+		release_run_buf( prg, run_buf );
 	}
 
 	debug( prg, REALM_INPUT, "data_undo_append_data: stream %p "
@@ -342,6 +722,9 @@ int data_undo_append_data( struct colm_program *prg, struct stream_impl_data *si
 
 static void data_destructor( program_t *prg, tree_t **sp, struct stream_impl_data *si )
 {
+	read_ahead_stop( prg, si );
+	decompress_end( prg, si );
+
 	if ( si->file != 0 )
 		close_stream_file( si->file );
 	
@@ -353,15 +736,23 @@ static void data_destructor( program_t *prg, tree_t **sp, struct stream_impl_dat
 	struct run_buf *buf = si->queue.head;
 	while ( buf != 0 ) {
 		struct run_buf *next = buf->next;
-		free( buf );
+		release_run_buf( prg, buf );
 		buf = next;
 	}
 
 	si->queue.head = 0;
 
+	if ( si->consumed_buf != 0 ) {
+		release_run_buf( prg, si->consumed_buf );
+		si->consumed_buf = 0;
+	}
+
 	if ( si->data != 0 )
 		free( (char*)si->data );
 
+	free( si->line_len );
+	free( si->out_buf );
+
 	/* FIXME: Need to leak this for now. Until we can return strings to a
 	 * program loader and free them at a later date (after the colm program is
 	 * deleted). */
@@ -384,6 +775,9 @@ static void data_flush_stream( struct colm_program *prg, struct stream_impl_data
 
 static void data_close_stream( struct colm_program *prg, struct stream_impl_data *si )
 {
+	read_ahead_stop( prg, si );
+	decompress_end( prg, si );
+
 	if ( si->file != 0 ) {
 		close_stream_file( si->file );
 		si->file = 0;
@@ -409,18 +803,15 @@ static int data_get_parse_block( struct colm_program *prg, struct stream_impl_da
 	while ( true ) {
 		if ( buf == 0 ) {
 			/* Got through the in-mem buffers without copying anything. */
-			struct run_buf *run_buf = new_run_buf( 0 );
-			int received = ss->funcs->get_data_source( prg, (struct stream_impl*)ss, run_buf->data, FSM_BUFSIZE );
-			if ( received == 0 ) {
-				free( run_buf );
+			struct run_buf *run_buf = data_source_buf( prg, ss );
+			if ( run_buf == 0 ) {
 				ret = INPUT_EOD;
 				break;
 			}
 
-			run_buf->length = received;
 			si_data_push_tail( ss, run_buf );
 
-			int slen = received;
+			int slen = run_buf->length;
 			*pdp = run_buf->data;
 			*copied = slen;
 			ret = INPUT_DATA;
@@ -492,11 +883,13 @@ static int data_consume_data( struct colm_program *prg, struct stream_impl_data
 			break;
 
 		struct run_buf *run_buf = si_data_pop_head( sid );
-		free( run_buf );
+		if ( sid->consumed_buf != 0 )
+			release_run_buf( prg, sid->consumed_buf );
+		sid->consumed_buf = run_buf;
 	}
 
 	debug( prg, REALM_INPUT, "data_consume_data: stream %p "
-			"ask: %d, consumed: %d, now: %d\n", sid, length, consumed, sid->consumed );
+			"ask: %d, consumed: %d, now: %ld\n", sid, length, consumed, sid->consumed );
 
 #ifdef DEBUG
 	dump_contents( prg, sid );
@@ -520,8 +913,12 @@ static int data_undo_consume_data( struct colm_program *prg, struct stream_impl_
 		end -= fill;
 		remaining -= fill;
 
-		undo_position_data( sid, end, fill );
-		memcpy( head->data + (head->offset - fill), end, fill );
+		undo_position_data( sid, end, fill, head->data, head->offset - fill );
+
+		/* Tokens taken in place send back the same bytes. */
+		char *dest = head->data + (head->offset - fill);
+		if ( dest != end )
+			memcpy( dest, end, fill );
 
 		head->offset -= fill;
 		sid->consumed -= fill;
@@ -529,16 +926,32 @@ static int data_undo_consume_data( struct colm_program *prg, struct stream_impl_
 
 	if ( remaining > 0 ) {
 		end -= remaining;
-		struct run_buf *new_buf = new_run_buf( 0 );
-		new_buf->length = remaining;
-		undo_position_data( sid, end, remaining );
-		memcpy( new_buf->data, end, remaining );
-		si_data_push_head( sid, new_buf );
-		sid->consumed -= amount;
+		struct run_buf *prev = sid->consumed_buf;
+		if ( prev != 0 && remaining <= prev->length ) {
+			/* Back onto the buffer it came from, which gives the column
+			 * when the line history does not reach. */
+			sid->consumed_buf = 0;
+			prev->offset = prev->length - remaining;
+			undo_position_data( sid, end, remaining, prev->data, prev->offset );
+
+			char *dest = prev->data + prev->offset;
+			if ( dest != end )
+				memcpy( dest, end, remaining );
+
+			si_data_push_head( sid, prev );
+		}
+		else {
+			struct run_buf *new_buf = new_run_buf( prg, remaining );
+			new_buf->length = remaining;
+			undo_position_data( sid, end, remaining, 0, 0 );
+			memcpy( new_buf->data, end, remaining );
+			si_data_push_head( sid, new_buf );
+		}
+		sid->consumed -= remaining;
 	}
 
 	debug( prg, REALM_INPUT, "data_undo_consume_data: stream %p "
-			"undid consume %d of %d bytes, consumed now %d, \n", sid, amount, length, sid->consumed );
+			"undid consume %d of %d bytes, consumed now %ld, \n", sid, amount, length, sid->consumed );
 
 #ifdef DEBUG
 	dump_contents( prg, sid );
@@ -551,9 +964,17 @@ static int data_undo_consume_data( struct colm_program *prg, struct stream_impl_
  * File Inputs
  */
 
+/* Takes what the file has ready instead of waiting for length bytes. Full
+ * reads then mean the source keeps ahead, and a pipe or terminal is parsed
+ * as the data arrives. */
 static int file_get_data_source( struct colm_program *prg, struct stream_impl_data *si, char *dest, int length )
 {
-	return fread( dest, 1, length, si->file );
+	while ( true ) {
+		ssize_t received = read( fileno( si->file ), dest, length );
+		if ( received < 0 && errno == EINTR )
+			continue;
+		return received > 0 ? received : 0;
+	}
 }
 
 /*
@@ -584,6 +1005,7 @@ struct stream_funcs_data file_funcs =
 {
 	&data_get_parse_block,
 	&data_get_data,
+	&data_get_data_pointer,
 	&file_get_data_source,
 
 	&data_consume_data,
@@ -604,6 +1026,7 @@ struct stream_funcs_data accum_funcs =
 {
 	&data_get_parse_block,
 	&data_get_data,
+	&data_get_data_pointer,
 	&accum_get_data_source,
 
 	&data_consume_data,
@@ -621,6 +1044,243 @@ struct stream_funcs_data accum_funcs =
 	&data_destructor,
 };
 
+#if defined(STREAM_DECOMPRESS)
+/*
+ * Compressed file inputs
+ */
+
+/* Decodes what is buffered of the file into dest. Returns the number of bytes
+ * produced. */
+static long decompress_step( struct decompress *dc, char *dest, long length )
+{
+	long produced = 0;
+
+	switch ( dc->kind ) {
+		case COMPRESS_NONE: {
+			long avail = dc->in_len - dc->in_pos;
+			produced = avail < length ? avail : length;
+			memcpy( dest, dc->in + dc->in_pos, produced );
+			dc->in_pos += produced;
+			break;
+		}
+#if defined(HAVE_LIBZ)
+		case COMPRESS_GZIP: {
+			dc->z.next_in = dc->in + dc->in_pos;
+			dc->z.avail_in = dc->in_len - dc->in_pos;
+			dc->z.next_out = (unsigned char*)dest;
+			dc->z.avail_out = length;
+
+			int res = inflate( &dc->z, Z_NO_FLUSH );
+
+			dc->in_pos = dc->in_len - dc->z.avail_in;
+			produced = length - dc->z.avail_out;
+
+			if ( res == Z_STREAM_END ) {
+				/* Files may hold several members one after the other. */
+				if ( dc->in_pos < dc->in_len || !dc->in_eof )
+					inflateReset( &dc->z );
+				else
+					dc->done = true;
+			}
+			else if ( res != Z_OK && res != Z_BUF_ERROR ) {
+				dc->done = true;
+			}
+			break;
+		}
+#endif
+#if defined(HAVE_LIBZSTD)
+		case COMPRESS_ZSTD: {
+			ZSTD_inBuffer in = { dc->in, (size_t)dc->in_len, (size_t)dc->in_pos };
+			ZSTD_outBuffer out = { dest, (size_t)length, 0 };
+
+			size_t res = ZSTD_decompressStream( dc->zstd, &out, &in );
+
+			dc->in_pos = in.pos;
+			produced = out.pos;
+
+			if ( ZSTD_isError( res ) )
+				dc->done = true;
+			break;
+		}
+#endif
+		default:
+			dc->done = true;
+			break;
+	}
+
+	return produced;
+}
+
+static void decompress_fill( struct decompress *dc )
+{
+	while ( true ) {
+		ssize_t received = read( dc->fd, dc->in, COMPRESSED_BUFSIZE );
+		if ( received < 0 && errno == EINTR )
+			continue;
+
+		if ( received <= 0 )
+			dc->in_eof = true;
+		else {
+			dc->in_len = received;
+			dc->in_pos = 0;
+		}
+		break;
+	}
+}
+
+static int decompress_get_data_source( struct colm_program *prg, struct stream_impl_data *si, char *dest, int length )
+{
+	struct decompress *dc = si->decompress;
+	if ( dc == 0 )
+		return 0;
+
+	long produced = 0;
+	while ( produced < length && !dc->done ) {
+		if ( dc->in_pos == dc->in_len && !dc->in_eof )
+			decompress_fill( dc );
+
+		long step = decompress_step( dc, dest + produced, length - produced );
+		produced += step;
+
+		/* Nothing left to decode. */
+		if ( step == 0 && dc->in_pos == dc->in_len && dc->in_eof )
+			break;
+	}
+
+	return produced;
+}
+
+struct stream_funcs_data decompress_funcs = 
+{
+	&data_get_parse_block,
+	&data_get_data,
+	&data_get_data_pointer,
+	&decompress_get_data_source,
+
+	&data_consume_data,
+	&data_undo_consume_data,
+
+	&data_transfer_loc,
+	&data_get_collect,
+	&data_flush_stream,
+	&data_close_stream,
+	&data_print_tree,
+	&data_split_consumed,
+	&data_append_data,
+	&data_undo_append_data,
+	&data_destructor,
+};
+#endif
+
+/*
+ * Mapped file inputs. The parse blocks and token data point straight into the
+ * mapping, which the program owns, so nothing is copied or buffered. Spans of
+ * memory handed over by a host program are read the same way, the host keeps
+ * them alive.
+ */
+
+/* Largest block handed to the scanner at once. */
+#define MMAP_BLOCK_MAX ( 1 << 30 )
+
+static int mmap_get_parse_block( struct colm_program *prg, struct stream_impl_data *ss, int *pskip, char **pdp, int *copied )
+{
+	long avail = ss->dlen - ss->offset;
+
+	*copied = 0;
+	if ( *pskip >= avail ) {
+		*pskip -= avail;
+		return INPUT_EOD;
+	}
+
+	avail -= *pskip;
+	*pdp = (char*)ss->data + ss->offset + *pskip;
+	*copied = avail < MMAP_BLOCK_MAX ? avail : MMAP_BLOCK_MAX;
+	*pskip = 0;
+	return INPUT_DATA;
+}
+
+static int mmap_get_data( struct colm_program *prg, struct stream_impl_data *ss, char *dest, int length )
+{
+	long avail = ss->dlen - ss->offset;
+	long take = avail < length ? avail : length;
+	if ( take > 0 )
+		memcpy( dest, ss->data + ss->offset, take );
+	return take;
+}
+
+static int mmap_get_data_pointer( struct colm_program *prg, struct stream_impl_data *ss, const char **pdp, int length )
+{
+	long avail = ss->dlen - ss->offset;
+	*pdp = ss->data + ss->offset;
+	return avail < length ? avail : length;
+}
+
+static int mmap_consume_data( struct colm_program *prg, struct stream_impl_data *sid, int length, location_t *loc )
+{
+	long avail = sid->dlen - sid->offset;
+	long take = avail < length ? avail : length;
+	if ( take > 0 ) {
+		if ( !loc_set( loc ) )
+			data_transfer_loc( prg, loc, sid );
+
+		update_position_data( sid, sid->data + sid->offset, take );
+		sid->offset += take;
+		sid->consumed += take;
+	}
+
+	debug( prg, REALM_INPUT, "mmap_consume_data: stream %p "
+			"ask: %d, consumed: %ld, now: %ld\n", sid, length, take, sid->consumed );
+
+	return take;
+}
+
+/* The data sent back is what was consumed from the mapping, so only the
+ * offset moves back. */
+static int mmap_undo_consume_data( struct colm_program *prg, struct stream_impl_data *sid, const char *data, int length )
+{
+	long amount = length;
+	if ( amount > sid->consumed )
+		amount = sid->consumed;
+
+	sid->offset -= amount;
+	sid->consumed -= amount;
+	undo_position_data( sid, sid->data + sid->offset, amount, sid->data, sid->offset );
+
+	debug( prg, REALM_INPUT, "mmap_undo_consume_data: stream %p "
+			"undid consume %ld of %d bytes, consumed now %ld, \n", sid, amount, length, sid->consumed );
+
+	return amount;
+}
+
+static void mmap_destructor( program_t *prg, tree_t **sp, struct stream_impl_data *si )
+{
+	/* The mapping stays with the program, tokens may still point into it. */
+	free( si->line_len );
+	free( si );
+}
+
+struct stream_funcs_data mmap_funcs = 
+{
+	&mmap_get_parse_block,
+	&mmap_get_data,
+	&mmap_get_data_pointer,
+	0, /* get_data_source */
+
+	&mmap_consume_data,
+	&mmap_undo_consume_data,
+
+	&data_transfer_loc,
+	&data_get_collect,
+	&data_flush_stream,
+	&data_close_stream,
+	&data_print_tree,
+
+	&data_split_consumed,
+	0, /* append_data */
+	0, /* undo_append_data */
+	&mmap_destructor,
+};
+
 static void si_data_init( struct stream_impl_data *is, char *name )
 {
 	memset( is, 0, sizeof(struct stream_impl_data) );
@@ -653,6 +1313,110 @@ static struct stream_impl *colm_impl_new_file( char *name, FILE *file )
 	return (struct stream_impl*)ss;
 }
 
+#if defined(HAVE_SYS_MMAN_H)
+/* Maps a regular file from its start. Returns zero if the file cannot be
+ * mapped, the caller then reads it through stdio. */
+static struct stream_impl *colm_impl_new_mmap( program_t *prg, const char *name, int fd )
+{
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) || st.st_size == 0 )
+		return 0;
+
+	if ( lseek( fd, 0, SEEK_CUR ) != 0 )
+		return 0;
+
+	void *base = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( base == MAP_FAILED )
+		return 0;
+
+#if defined(MADV_SEQUENTIAL)
+	madvise( base, st.st_size, MADV_SEQUENTIAL );
+#endif
+
+	struct stream_mapping *mapping = (struct stream_mapping*)malloc( sizeof(struct stream_mapping) );
+	mapping->base = base;
+	mapping->length = st.st_size;
+	mapping->next = prg->mappings;
+	prg->mappings = mapping;
+
+	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
+	si_data_init( si, colm_filename_add( prg, name ) );
+	si->funcs = (struct stream_funcs*)&mmap_funcs;
+	si->data = (const char*)base;
+	si->dlen = st.st_size;
+	return (struct stream_impl*)si;
+}
+#endif
+
+#if defined(STREAM_DECOMPRESS)
+/* Reads the file through a decoder chosen by its magic number. Returns zero
+ * for an uncompressed file that could be rewound, which the caller then opens
+ * as usual. Otherwise the stream owns the descriptor. */
+static struct stream_impl *colm_impl_new_compressed( program_t *prg, const char *name, int fd )
+{
+	struct decompress *dc = (struct decompress*)malloc( sizeof(struct decompress) );
+	memset( dc, 0, sizeof(struct decompress) );
+	dc->fd = fd;
+	dc->in = (unsigned char*)malloc( COMPRESSED_BUFSIZE );
+
+	/* Enough of the file for the magic number. */
+	while ( dc->in_len < 4 && !dc->in_eof ) {
+		ssize_t received = read( fd, dc->in + dc->in_len, COMPRESSED_BUFSIZE - dc->in_len );
+		if ( received < 0 && errno == EINTR )
+			continue;
+		if ( received <= 0 )
+			dc->in_eof = true;
+		else
+			dc->in_len += received;
+	}
+
+	const unsigned char *m = dc->in;
+#if defined(HAVE_LIBZ)
+	if ( dc->in_len >= 2 && m[0] == 0x1f && m[1] == 0x8b ) {
+		dc->kind = COMPRESS_GZIP;
+		/* Window size 15, plus 32 to accept the gzip header. */
+		if ( inflateInit2( &dc->z, 15 + 32 ) != Z_OK )
+			dc->done = true;
+	}
+#endif
+#if defined(HAVE_LIBZSTD)
+	if ( dc->in_len >= 4 && m[0] == 0x28 && m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd ) {
+		dc->kind = COMPRESS_ZSTD;
+		dc->zstd = ZSTD_createDStream();
+		if ( dc->zstd == 0 || ZSTD_isError( ZSTD_initDStream( dc->zstd ) ) )
+			dc->done = true;
+	}
+#endif
+
+	if ( dc->kind == COMPRESS_NONE && lseek( fd, 0, SEEK_SET ) == 0 ) {
+		free( dc->in );
+		free( dc );
+		return 0;
+	}
+
+	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
+	si_data_init( si, colm_filename_add( prg, name ) );
+	si->funcs = (struct stream_funcs*)&decompress_funcs;
+	si->decompress = dc;
+	si->bufsize = COMPRESSED_BUFSIZE;
+	return (struct stream_impl*)si;
+}
+#endif
+
+void colm_release_mappings( program_t *prg )
+{
+	struct stream_mapping *mapping = prg->mappings;
+	while ( mapping != 0 ) {
+		struct stream_mapping *next = mapping->next;
+#if defined(HAVE_SYS_MMAN_H)
+		munmap( mapping->base, mapping->length );
+#endif
+		free( mapping );
+		mapping = next;
+	}
+	prg->mappings = 0;
+}
+
 static struct stream_impl *colm_impl_new_fd( char *name, long fd )
 {
 	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
@@ -662,7 +1426,7 @@ static struct stream_impl *colm_impl_new_fd( char *name, long fd )
 	return (struct stream_impl*)si;
 }
 
-struct stream_impl *colm_impl_consumed( char *name, int len )
+struct stream_impl *colm_impl_consumed( char *name, long len )
 {
 	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
 	si_data_init( si, name );
@@ -692,6 +1456,36 @@ struct stream_impl *colm_impl_new_text( char *name, const char *data, int len )
 	return (struct stream_impl*)si;
 }
 
+/* Reads the caller's memory in place. Positions continue from the end of
+ * the previous span of the same input, if there is one. */
+struct stream_impl *colm_impl_new_span( char *name, const char *data, long len,
+		struct stream_impl *prev )
+{
+	struct stream_impl_data *si = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
+	si_data_init( si, name );
+	si->funcs = (struct stream_funcs*)&mmap_funcs;
+	si->data = data;
+	si->dlen = len;
+
+	if ( prev != 0 ) {
+		struct stream_impl_data *ps = (struct stream_impl_data*)prev;
+		const char *p = ps->data + ps->offset, *end = ps->data + ps->dlen, *nl;
+
+		si->line = ps->line;
+		si->column = ps->column;
+		si->byte = ps->byte + ( end - p );
+
+		while ( p < end && ( nl = memchr( p, '\n', end - p ) ) != 0 ) {
+			si->line += 1;
+			si->column = 1;
+			p = nl + 1;
+		}
+		si->column += end - p;
+	}
+
+	return (struct stream_impl*)si;
+}
+
 struct stream_impl *colm_impl_new_collect( char *name )
 {
 	struct stream_impl_data *ss = (struct stream_impl_data*)malloc(sizeof(struct stream_impl_data));
@@ -717,7 +1511,19 @@ str_t *collect_string( program_t *prg, stream_t *s )
 
 stream_t *colm_stream_open_fd( program_t *prg, char *name, long fd )
 {
-	struct stream_impl *impl = colm_impl_new_fd( colm_filename_add( prg, name ), fd );
+	struct stream_impl *impl = 0;
+
+#if defined(HAVE_SYS_MMAN_H)
+	/* Standard input redirected from a file. */
+	if ( fd == 0 )
+		impl = colm_impl_new_mmap( prg, name, fd );
+#endif
+
+	if ( impl == 0 ) {
+		impl = colm_impl_new_fd( colm_filename_add( prg, name ), fd );
+		if ( fd == 0 )
+			read_ahead_start( prg, (struct stream_impl_data*)impl );
+	}
 
 	struct colm_stream *s = colm_stream_new_struct( prg );
 	s->impl = impl;
@@ -732,8 +1538,13 @@ stream_t *colm_stream_open_file( program_t *prg, tree_t *name, tree_t *mode )
 
 	const char *given_mode = string_data(head_mode);
 	const char *fopen_mode = 0;
+	bool decompress = false;
 	if ( memcmp( given_mode, "r", string_length(head_mode) ) == 0 )
 		fopen_mode = "rb";
+	else if ( memcmp( given_mode, "rz", string_length(head_mode) ) == 0 ) {
+		fopen_mode = "rb";
+		decompress = true;
+	}
 	else if ( memcmp( given_mode, "w", string_length(head_mode) ) == 0 )
 		fopen_mode = "wb";
 	else if ( memcmp( given_mode, "a", string_length(head_mode) ) == 0 )
@@ -747,10 +1558,41 @@ stream_t *colm_stream_open_file( program_t *prg, tree_t *name, tree_t *mode )
 	memcpy( file_name, string_data(head_name), string_length(head_name) );
 	file_name[string_length(head_name)] = 0;
 
-	FILE *file = fopen( file_name, fopen_mode );
-	if ( file != 0 ) {
+	struct stream_impl *impl = 0;
+
+#if defined(STREAM_DECOMPRESS)
+	if ( decompress ) {
+		int fd = open( file_name, O_RDONLY );
+		if ( fd >= 0 ) {
+			impl = colm_impl_new_compressed( prg, file_name, fd );
+			if ( impl == 0 )
+				close( fd );
+		}
+	}
+#endif
+
+#if defined(HAVE_SYS_MMAN_H)
+	if ( impl == 0 && fopen_mode[0] == 'r' ) {
+		int fd = open( file_name, O_RDONLY );
+		if ( fd >= 0 ) {
+			impl = colm_impl_new_mmap( prg, file_name, fd );
+			close( fd );
+		}
+	}
+#endif
+
+	if ( impl == 0 ) {
+		FILE *file = fopen( file_name, fopen_mode );
+		if ( file != 0 ) {
+			impl = colm_impl_new_file( colm_filename_add( prg, file_name ), file );
+			if ( fopen_mode[0] == 'r' )
+				read_ahead_start( prg, (struct stream_impl_data*)impl );
+		}
+	}
+
+	if ( impl != 0 ) {
 		stream = colm_stream_new_struct( prg );
-		stream->impl = colm_impl_new_file( colm_filename_add( prg, file_name ), file );
+		stream->impl = impl;
 	}
 
 	free( file_name );
@@ -62,27 +62,14 @@ tree_t *construct_string( program_t *prg, head_t *s )
 
 head_t *string_copy( program_t *prg, head_t *head )
 {
-	head_t *result = 0;
-	if ( head != 0 ) {
-		if ( (char*)(head+1) == head->data )
-			result = string_alloc_full( prg, head->data, head->length );
-		else
-			result = colm_string_alloc_pointer( prg, head->data, head->length );
-
-		if ( head->location != 0 ) {
-			result->location = location_allocate( prg );
-			result->location->name = head->location->name;
-			result->location->line = head->location->line;
-			result->location->column = head->location->column;
-			result->location->byte = head->location->byte;
-		}
-	}
-	return result;
+	if ( head != 0 )
+		head->refs += 1;
+	return head;
 }
 
 void string_free( program_t *prg, head_t *head )
 {
-	if ( head != 0 ) {
+	if ( head != 0 && --head->refs == 0 ) {
 		if ( head->location != 0 )
 			location_free( prg, head->location );
 
@@ -114,6 +101,7 @@ long string_length( head_t *head )
 void string_shorten( head_t *head, long newlen )
 {
 	assert( newlen <= head->length );
+	assert( head->refs == 1 );
 	head->length = newlen;
 }
 
@@ -126,6 +114,7 @@ head_t *init_str_space( long length )
 	head->data = (char*)(head+1);
 	head->length = length;
 	head->location = 0;
+	head->refs = 1;
 
 	/* Save the pointer to the data. */
 	return head;
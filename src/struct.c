@@ -29,6 +29,7 @@
 
 #include "internal.h"
 #include "bytecode.h"
+#include <colm/map.h>
 
 struct colm_tree *colm_get_global( program_t *prg, long pos )
 {
@@ -49,6 +50,21 @@ void colm_struct_add( program_t *prg, struct colm_struct *item )
 	}
 }
 
+void colm_struct_remove( program_t *prg, struct colm_struct *item )
+{
+	if ( item->prev == 0 )
+		prg->heap.head = item->next;
+	else
+		item->prev->next = item->next;
+
+	if ( item->next == 0 )
+		prg->heap.tail = item->prev;
+	else
+		item->next->prev = item->prev;
+
+	item->prev = item->next = 0;
+}
+
 struct colm_struct *colm_struct_new_size( program_t *prg, int size )
 {
 	size_t memsize = sizeof(struct colm_struct) + ( sizeof(tree_t*) * size );
@@ -144,6 +160,13 @@ map_t *colm_map_new( struct colm_program *prg )
 	return map;
 }
 
+map_t *colm_hashmap_new( struct colm_program *prg )
+{
+	map_t *map = colm_map_new( prg );
+	map->destructor = &colm_hashmap_destroy;
+	return map;
+}
+
 struct_t *colm_construct_generic( program_t *prg, long generic_id, int stop_id )
 {
 	struct generic_info *generic_info = &prg->rtd->generic_info[generic_id];
@@ -155,12 +178,24 @@ struct_t *colm_construct_generic( program_t *prg, long generic_id, int stop_id )
 			new_generic = (struct_t*) map;
 			break;
 		}
+		case GEN_HASHMAP: {
+			map_t *map = colm_hashmap_new( prg );
+			map->generic_info = generic_info;
+			new_generic = (struct_t*) map;
+			break;
+		}
 		case GEN_LIST: {
 			list_t *list = colm_list_new( prg );
 			list->generic_info = generic_info;
 			new_generic = (struct_t*) list;
 			break;
 		}
+		case GEN_VECTOR: {
+			vector_t *vector = colm_vector_new( prg );
+			vector->generic_info = generic_info;
+			new_generic = (struct_t*) vector;
+			break;
+		}
 		case GEN_PARSER: {
 			parser_t *parser = colm_parser_new( prg, generic_info, stop_id, 0 );
 			parser->input = colm_input_new( prg );
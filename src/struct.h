@@ -54,6 +54,9 @@ typedef struct colm_parser
 	struct pda_run *pda_run;
 	struct colm_input *input;
 	tree_t *result;
+
+	/* Most recent span sent by the host. */
+	struct stream_impl *last_span;
 } parser_t;
 
 /* Must overlay colm_inbuilt. */
@@ -95,6 +98,18 @@ typedef struct colm_list
 	struct generic_info *generic_info;
 } list_t;
 
+/* Must overlay colm_inbuilt. */
+typedef struct colm_vector
+{
+	short id;
+	struct colm_struct *prev, *next;
+	colm_destructor_t destructor;
+
+	value_t *data;
+	long len, alloc;
+	struct generic_info *generic_info;
+} vector_t;
+
 typedef struct colm_map_el
 {
 	tree_t *key;
@@ -116,11 +131,20 @@ typedef struct colm_map
 	struct colm_map_el *head, *tail, *root;
 	long tree_size;
 	struct generic_info *generic_info;
+
+	/* Number of elements appended to the list tail that are not yet linked
+	 * into the tree. */
+	long pending;
+
+	/* Open addressing table of a hashmap. Unused by the AVL map. */
+	struct colm_map_el **table;
+	long table_len;
 } map_t;
 
 struct colm_struct *colm_struct_new_size( struct colm_program *prg, int size );
 struct colm_struct *colm_struct_new( struct colm_program *prg, int id );
 void colm_struct_add( struct colm_program *prg, struct colm_struct *item );
+void colm_struct_remove( struct colm_program *prg, struct colm_struct *item );
 void colm_struct_delete( struct colm_program *prg, struct colm_tree **sp,
 		struct colm_struct *el );
 
@@ -150,6 +174,8 @@ struct colm_struct *colm_struct_inbuilt( struct colm_program *prg, int size,
 
 parser_t *colm_parser_new( program_t *prg, struct generic_info *gi, int stop_id, int reducer );
 input_t *colm_input_new( struct colm_program *prg );
+void colm_input_append_impl( struct colm_program *prg, input_t *input,
+		struct stream_impl *impl );
 stream_t *colm_stream_new_struct( struct colm_program *prg );
 
 list_t *colm_list_new( struct colm_program *prg );
@@ -161,7 +187,10 @@ list_el_t *colm_list_detach_head( list_t *list );
 list_el_t *colm_list_detach_tail( list_t *list );
 long colm_list_length( list_t *list );
 
+vector_t *colm_vector_new( struct colm_program *prg );
+
 map_t *colm_map_new( struct colm_program *prg );
+map_t *colm_hashmap_new( struct colm_program *prg );
 struct colm_struct *colm_map_el_get( struct colm_program *prg,
 		map_el_t *map_el, word_t gen_id, word_t field );
 struct colm_struct *colm_map_get( struct colm_program *prg, map_t *map,
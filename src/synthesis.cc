@@ -724,7 +724,10 @@ bool castAssignment( Compiler *pd, CodeVect &code, UniqueType *destUT,
 
 	if ( destUT->typeId == TYPE_TREE && srcUT->typeId == TYPE_TREE &&
 			srcUT->langEl == pd->anyLangEl )
+	{
+		destUT->langEl->unknownContents = true;
 		return true;
+	}
 
 	return false;
 }
@@ -904,7 +907,8 @@ IterImpl *LangVarRef::chooseTriterCall( Compiler *pd,
 				iterImpl = new IterImpl( IterImpl::ListVal );
 		}
 
-		if ( exprUT->typeId == TYPE_GENERIC && exprUT->generic->typeId == GEN_MAP ) {
+		if ( exprUT->typeId == TYPE_GENERIC && ( exprUT->generic->typeId == GEN_MAP ||
+				exprUT->generic->typeId == GEN_HASHMAP ) ) {
 			if ( searchUT == exprUT->generic->elUt )
 				iterImpl = new IterImpl( IterImpl::MapEl );
 			else
@@ -1341,6 +1345,9 @@ UniqueType *LangTerm::evaluateCast( Compiler *pd, CodeVect &code ) const
 	expr->evaluate( pd, code );
 	code.append( IN_TREE_CAST );
 	code.appendHalf( typeRef->uniqueType->langEl->id );
+
+	/* The cast keeps the children of whatever was cast. */
+	typeRef->uniqueType->langEl->unknownContents = true;
 	return typeRef->uniqueType;
 }
 
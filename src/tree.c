@@ -868,6 +868,9 @@ tree_t *split_tree( program_t *prg, tree_t *tree )
 		}
 
 		assert( tree->refs == 1 );
+
+		/* The caller is about to modify it. */
+		tree->hash = 0;
 	}
 	return tree;
 }
@@ -914,6 +917,8 @@ free_tree:
 			tree->refs -= 1;
 			if ( tree->refs == 0 )
 				goto free_tree;
+			if ( tree->flags & AF_INDEXED )
+				colm_tree_index_unused( prg, sp, tree );
 		}
 	}
 }
@@ -934,6 +939,8 @@ void colm_tree_downref( program_t *prg, tree_t **sp, tree_t *tree )
 		tree->refs -= 1;
 		if ( tree->refs == 0 )
 			tree_free_rec( prg, sp, tree );
+		else if ( tree->flags & AF_INDEXED )
+			colm_tree_index_unused( prg, sp, tree );
 	}
 }
 
@@ -1145,6 +1152,7 @@ void colm_tree_set_field( program_t *prg, tree_t *tree, long field, tree_t *valu
 	if ( value != 0 )
 		assert( value->refs >= 1 );
 	colm_tree_set_attr( tree, field, value );
+	tree->hash = 0;
 }
 
 tree_t *colm_tree_get_field( tree_t *tree, word_t field )
@@ -1165,64 +1173,68 @@ tree_t *get_field_split( program_t *prg, tree_t *tree, word_t field )
 	return split;
 }
 
-/* This must traverse in the same order that the bindId assignments are done
- * in. */
-int match_pattern( tree_t **bindings, program_t *prg, long pat, kid_t *kid, int check_next )
-{
-	struct pat_cons_node *nodes = prg->rtd->pat_repl_nodes;
+/*
+ * Pending work for the tree walks below. Recursing on both the child and the
+ * next pointer puts a C stack frame on every element of a long list. The
+ * walks loop down the next pointers and keep only the siblings still to be
+ * visited, in a small local buffer that moves to the heap for deep trees.
+ */
+#define TREE_WALK_LOCAL 32
 
-	/* match node, recurse on children. */
-	if ( pat != -1 && kid != 0 ) {
-		if ( nodes[pat].id == kid->tree->id ) {
-			/* If the pattern node has data, then this means we need to match
-			 * the data against the token data. */
-			if ( nodes[pat].data != 0 ) {
-				/* Check the length of token text. */
-				if ( nodes[pat].length != string_length( kid->tree->tokdata ) )
-					return false;
-
-				/* Check the token text data. */
-				if ( nodes[pat].length > 0 && memcmp( nodes[pat].data, 
-						string_data( kid->tree->tokdata ), nodes[pat].length ) != 0 )
-					return false;
-			}
+struct tree_walk_el
+{
+	kid_t *kid1;
+	kid_t *kid2;
+	tree_t *tree;
 
-			/* No failure, all okay. */
-			if ( nodes[pat].bind_id > 0 ) {
-				bindings[nodes[pat].bind_id] = kid->tree;
-			}
+	/* The hash so far. */
+	long val;
+};
 
-			/* If we didn't match a terminal duplicate of a nonterm then check
-			 * down the children. */
-			if ( !nodes[pat].stop ) {
-				/* Check for failure down child branch. */
-				int child_check = match_pattern( bindings, prg, 
-						nodes[pat].child, tree_child( prg, kid->tree ), true );
-				if ( ! child_check )
-					return false;
-			}
+struct tree_walk
+{
+	struct tree_walk_el *data;
+	long len;
+	long alloc;
+	struct tree_walk_el local[TREE_WALK_LOCAL];
+};
 
-			/* If checking next, then look for failure there. */
-			if ( check_next ) {
-				int next_check = match_pattern( bindings, prg, 
-						nodes[pat].next, kid->next, true );
-				if ( ! next_check )
-					return false;
-			}
+static void tree_walk_init( struct tree_walk *walk )
+{
+	walk->data = walk->local;
+	walk->len = 0;
+	walk->alloc = TREE_WALK_LOCAL;
+}
 
-			return true;
+static void tree_walk_push( struct tree_walk *walk, kid_t *kid1, kid_t *kid2,
+		tree_t *tree, long val )
+{
+	if ( walk->len == walk->alloc ) {
+		walk->alloc *= 2;
+		if ( walk->data == walk->local ) {
+			walk->data = malloc( sizeof(struct tree_walk_el) * walk->alloc );
+			memcpy( walk->data, walk->local, sizeof(struct tree_walk_el) * walk->len );
+		}
+		else {
+			walk->data = realloc( walk->data, sizeof(struct tree_walk_el) * walk->alloc );
 		}
-	}
-	else if ( pat == -1 && kid == 0 ) {
-		/* Both null is a match. */
-		return 1;
 	}
 
-	return false;
+	struct tree_walk_el *el = &walk->data[walk->len++];
+	el->kid1 = kid1;
+	el->kid2 = kid2;
+	el->tree = tree;
+	el->val = val;
 }
 
+static void tree_walk_clear( struct tree_walk *walk )
+{
+	if ( walk->data != walk->local )
+		free( walk->data );
+}
 
-long colm_cmp_tree( program_t *prg, const tree_t *tree1, const tree_t *tree2 )
+/* Compares one pair of nodes, not their children. */
+static long cmp_tree_node( const tree_t *tree1, const tree_t *tree2 )
 {
 	long cmpres = 0;
 	if ( tree1 == 0 ) {
@@ -1259,27 +1271,323 @@ long colm_cmp_tree( program_t *prg, const tree_t *tree1, const tree_t *tree2 )
 				return cmpres;
 		}
 	}
+	return 0;
+}
+
+long colm_cmp_tree( program_t *prg, const tree_t *tree1, const tree_t *tree2 )
+{
+	struct tree_walk walk;
+	long cmpres = cmp_tree_node( tree1, tree2 );
+	if ( cmpres != 0 || tree1 == 0 || tree1 == tree2 )
+		return cmpres;
 
 	kid_t *kid1 = tree_child( prg, tree1 );
 	kid_t *kid2 = tree_child( prg, tree2 );
 
+	tree_walk_init( &walk );
+
 	while ( true ) {
-		if ( kid1 == 0 && kid2 == 0 )
-			return 0;
-		else if ( kid1 == 0 && kid2 != 0 )
-			return -1;
-		else if ( kid1 != 0 && kid2 == 0 )
-			return 1;
+		if ( kid1 == 0 && kid2 == 0 ) {
+			/* End of both child lists. Go back up to the siblings. */
+			if ( walk.len == 0 )
+				break;
+
+			walk.len -= 1;
+			kid1 = walk.data[walk.len].kid1;
+			kid2 = walk.data[walk.len].kid2;
+			continue;
+		}
+		else if ( kid1 == 0 && kid2 != 0 ) {
+			cmpres = -1;
+			break;
+		}
+		else if ( kid1 != 0 && kid2 == 0 ) {
+			cmpres = 1;
+			break;
+		}
+
+		cmpres = cmp_tree_node( kid1->tree, kid2->tree );
+		if ( cmpres != 0 )
+			break;
+
+		if ( kid1->tree == 0 || kid1->tree == kid2->tree ) {
+			/* Shared subtrees are equal. */
+			kid1 = kid1->next;
+			kid2 = kid2->next;
+		}
 		else {
-			cmpres = colm_cmp_tree( prg, kid1->tree, kid2->tree );
-			if ( cmpres != 0 )
-				return cmpres;
+			/* Children first, then the siblings. */
+			if ( kid1->next != 0 || kid2->next != 0 )
+				tree_walk_push( &walk, kid1->next, kid2->next, 0, 0 );
+
+			kid1 = tree_child( prg, kid1->tree );
+			kid2 = tree_child( prg, kid2->tree );
+		}
+	}
+
+	tree_walk_clear( &walk );
+	return cmpres;
+}
+
+
+/*
+ * Structural hashes. Trees that colm_cmp_tree finds equal hash the same, so
+ * different hashes settle inequality without a walk. The hash is kept in the
+ * tree, zero meaning not computed. split_tree and split_ref clear it on the
+ * trees they hand out for modification.
+ */
+#define TREE_HASH_NIL 0x9e3779b9u
+#define TREE_HASH_END 0x85ebca6bu
+
+static unsigned int hash_mix( unsigned int h, unsigned long v )
+{
+	h ^= (unsigned int)v ^ (unsigned int)( v >> 16 >> 16 );
+	h *= 0x01000193u;
+	h ^= h >> 15;
+	return h;
+}
+
+static unsigned int hash_data( unsigned int h, const char *data, long length )
+{
+	long i;
+	for ( i = 0; i < length; i++ ) {
+		h ^= (unsigned char)data[i];
+		h *= 0x01000193u;
+	}
+	return hash_mix( h, length );
+}
+
+/* The node's own data, as cmp_tree_node compares it. */
+static unsigned int hash_node( const tree_t *tree )
+{
+	unsigned int h = hash_mix( 0x811c9dc5u, tree->id );
+	if ( tree->id == LEL_ID_PTR )
+		h = hash_mix( h, ((pointer_t*)tree)->value );
+	else if ( tree->id == LEL_ID_STR ) {
+		head_t *value = ((str_t*)tree)->value;
+		h = hash_data( h, string_data( value ), string_length( value ) );
+	}
+	else if ( tree->tokdata != 0 )
+		h = hash_data( h, tree->tokdata->data, tree->tokdata->length );
+	return h;
+}
+
+unsigned int colm_tree_hash( program_t *prg, tree_t *tree )
+{
+	struct tree_walk walk;
+	unsigned int h = 0;
+
+	if ( tree == 0 )
+		return TREE_HASH_NIL;
+	if ( tree->hash != 0 )
+		return tree->hash;
+
+	/* Post order. Each entry collects the hashes of its children. */
+	tree_walk_init( &walk );
+	tree_walk_push( &walk, tree_child( prg, tree ), 0, tree, hash_node( tree ) );
+
+	while ( walk.len > 0 ) {
+		struct tree_walk_el *top = &walk.data[walk.len - 1];
+		kid_t *kid = top->kid1;
+
+		if ( kid == 0 ) {
+			h = hash_mix( top->val, TREE_HASH_END );
+			if ( h == 0 )
+				h = 1;
+			top->tree->hash = h;
+
+			walk.len -= 1;
+			if ( walk.len > 0 ) {
+				top = &walk.data[walk.len - 1];
+				top->val = hash_mix( top->val, h );
+			}
+		}
+		else {
+			top->kid1 = kid->next;
+
+			if ( kid->tree == 0 )
+				top->val = hash_mix( top->val, TREE_HASH_NIL );
+			else if ( kid->tree->hash != 0 )
+				top->val = hash_mix( top->val, kid->tree->hash );
+			else {
+				tree_walk_push( &walk, tree_child( prg, kid->tree ), 0,
+						kid->tree, hash_node( kid->tree ) );
+			}
 		}
+	}
+
+	tree_walk_clear( &walk );
+	return h;
+}
+
+int colm_tree_eql( program_t *prg, tree_t *tree1, tree_t *tree2 )
+{
+	if ( tree1 == tree2 )
+		return true;
+
+	if ( prg->tree_hash && tree1 != 0 && tree2 != 0 &&
+			colm_tree_hash( prg, tree1 ) != colm_tree_hash( prg, tree2 ) )
+		return false;
+
+	return colm_cmp_tree( prg, tree1, tree2 ) == 0;
+}
+
+/*
+ * Token sharing. Tokens and ignore lists of a finished parse that are
+ * identical down to their ignores and attributes are replaced by one copy.
+ * The table used to find them lives only for the walk over one parse, so
+ * nothing is kept once the result is handed out. Nothing modifies a tree
+ * with more than one reference in place, so the sharing is invisible except
+ * for token locations, which become those of the first occurrence.
+ */
+#define SHARE_TABLE_MIN 1024
+#define SHARE_TABLE_MAX ( 1 << 22 )
+
+static int share_candidate( program_t *prg, tree_t *tree )
+{
+	return tree->id < prg->rtd->first_non_term_id || tree->id == LEL_ID_IGNORE;
+}
+
+/* Exact: the ignores and attributes count, and children are compared by
+ * identity since they have been shared already. */
+static unsigned int share_hash( tree_t *tree )
+{
+	unsigned int h = hash_mix( 0x811c9dc5u, tree->id );
+	h = hash_mix( h, tree->flags );
+	if ( tree->tokdata != 0 )
+		h = hash_data( h, tree->tokdata->data, tree->tokdata->length );
+	kid_t *kid;
+	for ( kid = tree->child; kid != 0; kid = kid->next )
+		h = hash_mix( h, (unsigned long)kid->tree );
+	return h;
+}
+
+static int share_same( tree_t *tree1, tree_t *tree2 )
+{
+	if ( tree1->id != tree2->id || tree1->flags != tree2->flags )
+		return false;
+
+	long len1 = string_length( tree1->tokdata ), len2 = string_length( tree2->tokdata );
+	if ( ( tree1->tokdata == 0 ) != ( tree2->tokdata == 0 ) || len1 != len2 ||
+			( len1 > 0 && memcmp( tree1->tokdata->data, tree2->tokdata->data, len1 ) != 0 ) )
+		return false;
+
+	kid_t *kid1 = tree1->child, *kid2 = tree2->child;
+	while ( kid1 != 0 && kid2 != 0 ) {
+		if ( kid1->tree != kid2->tree )
+			return false;
 		kid1 = kid1->next;
 		kid2 = kid2->next;
 	}
+	return kid1 == 0 && kid2 == 0;
+}
+
+/* Open addressing. The table holds a reference to each tree in it, so
+ * trees it points to are not freed when a parent is replaced. */
+struct share_table
+{
+	tree_t **data;
+	long len;
+	long alloc;
+};
+
+static void share_insert( struct share_table *table, tree_t *tree, unsigned int h )
+{
+	long mask = table->alloc - 1;
+	long i = h & mask;
+	while ( table->data[i] != 0 )
+		i = ( i + 1 ) & mask;
+	table->data[i] = tree;
+	table->len += 1;
+}
+
+static void share_grow( struct share_table *table )
+{
+	tree_t **old = table->data;
+	long i, old_alloc = table->alloc;
+
+	table->alloc = old_alloc == 0 ? SHARE_TABLE_MIN : old_alloc * 2;
+	table->data = calloc( table->alloc, sizeof(tree_t*) );
+	table->len = 0;
+
+	for ( i = 0; i < old_alloc; i++ ) {
+		if ( old[i] != 0 )
+			share_insert( table, old[i], share_hash( old[i] ) );
+	}
+	free( old );
+}
+
+/* Replace the kid's tree with the shared one, or make it the shared one. */
+static void share_kid( program_t *prg, tree_t **sp,
+		struct share_table *table, kid_t *kid )
+{
+	tree_t *tree = kid->tree;
+	unsigned int h = share_hash( tree );
+
+	if ( table->alloc > 0 ) {
+		long mask = table->alloc - 1;
+		long i = h & mask;
+		while ( table->data[i] != 0 ) {
+			tree_t *shared = table->data[i];
+			if ( shared != tree && share_same( shared, tree ) ) {
+				colm_tree_upref( prg, shared );
+				kid->tree = shared;
+				colm_tree_downref( prg, sp, tree );
+				return;
+			}
+			i = ( i + 1 ) & mask;
+		}
+	}
+
+	if ( table->len < SHARE_TABLE_MAX ) {
+		if ( ( table->len + 1 ) * 2 > table->alloc )
+			share_grow( table );
+		colm_tree_upref( prg, tree );
+		share_insert( table, tree, h );
+	}
 }
 
+void colm_share_tokens( program_t *prg, tree_t **sp, tree_t *tree )
+{
+	struct share_table table = { 0, 0, 0 };
+	struct tree_walk walk;
+	long i;
+
+	if ( tree == 0 )
+		return;
+
+	/* Post order over every kid, ignores and attributes included, so
+	 * children are shared before their parents. Trees with other owners are
+	 * left as they are. */
+	tree_walk_init( &walk );
+	tree_walk_push( &walk, tree->child, 0, 0, 0 );
+
+	while ( walk.len > 0 ) {
+		struct tree_walk_el *top = &walk.data[walk.len - 1];
+		kid_t *kid = top->kid1;
+
+		if ( kid == 0 ) {
+			kid_t *owner = top->kid2;
+			walk.len -= 1;
+			if ( owner != 0 && share_candidate( prg, owner->tree ) )
+				share_kid( prg, sp, &table, owner );
+		}
+		else {
+			top->kid1 = kid->next;
+			if ( kid->tree != 0 && kid->tree->refs == 1 )
+				tree_walk_push( &walk, kid->tree->child, kid, 0, 0 );
+		}
+	}
+
+	tree_walk_clear( &walk );
+
+	/* The parse result holds the shared trees from here on. */
+	for ( i = 0; i < table.alloc; i++ ) {
+		if ( table.data[i] != 0 )
+			colm_tree_downref( prg, sp, table.data[i] );
+	}
+	free( table.data );
+}
 
 void split_ref( program_t *prg, tree_t ***psp, ref_t *from_ref )
 {
@@ -1303,13 +1611,14 @@ void split_ref( program_t *prg, tree_t ***psp, ref_t *from_ref )
 			kid_t *old_next_kid_down = next_down != 0 ? next_down->kid : 0;
 			kid_t *new_next_kid_down = 0;
 
-			tree_t *new_tree = colm_copy_tree( prg, ref->kid->tree, 
+			tree_t *old_tree = ref->kid->tree;
+			tree_t *new_tree = colm_copy_tree( prg, old_tree, 
 					old_next_kid_down, &new_next_kid_down );
 			colm_tree_upref( prg, new_tree );
 			
 			/* Downref the original. Don't need to consider freeing because
 			 * refs were > 1. */
-			ref->kid->tree->refs -= 1;
+			old_tree->refs -= 1;
 
 			while ( ref != 0 && ref != next_down ) {
 				next = ref->next;
@@ -1324,8 +1633,15 @@ void split_ref( program_t *prg, tree_t ***psp, ref_t *from_ref )
 				next_down->kid = new_next_kid_down;
 				next_down = next_down->next;
 			}
+
+			/* Indices of the original no longer describe the tree. */
+			if ( prg->index_count > 0 )
+				colm_tree_index_split( prg, *psp, old_tree );
 		}
 		else {
+			/* Modified in place below here. */
+			ref->kid->tree->hash = 0;
+
 			/* Reset the list as we go down. */
 			next = ref->next;
 			ref->next = 0;
@@ -1530,30 +1846,54 @@ tree_t *map_store( program_t *prg, map_t *map, tree_t *key, tree_t *element )
 
 static tree_t *tree_search_kid( program_t *prg, kid_t *kid, long id )
 {
-	/* This node the one? */
-	if ( kid->tree->id == id )
-		return kid->tree;
-
+	struct tree_walk walk;
 	tree_t *res = 0;
 
-	/* Search children. */
-	kid_t *child = tree_child( prg, kid->tree );
-	if ( child != 0 )
-		res = tree_search_kid( prg, child, id );
-	
-	/* Search siblings. */
-	if ( res == 0 && kid->next != 0 )
-		res = tree_search_kid( prg, kid->next, id );
+	tree_walk_init( &walk );
+
+	while ( true ) {
+		/* This node the one? */
+		if ( kid->tree->id == id ) {
+			res = kid->tree;
+			break;
+		}
+
+		/* Search children, if the grammar allows them to hold it. */
+		kid_t *child = lel_can_contain( prg->rtd->lel_info, kid->tree->id, id ) ?
+				tree_child( prg, kid->tree ) : 0;
+
+		if ( child != 0 ) {
+			/* Siblings after the children. */
+			if ( kid->next != 0 )
+				tree_walk_push( &walk, kid->next, 0, 0, 0 );
+			kid = child;
+		}
+		else if ( kid->next != 0 )
+			kid = kid->next;
+		else if ( walk.len > 0 )
+			kid = walk.data[--walk.len].kid1;
+		else
+			break;
+	}
 
+	tree_walk_clear( &walk );
 	return res;	
 }
 
 tree_t *tree_search( program_t *prg, tree_t *tree, long id )
 {
 	tree_t *res = 0;
+	struct tree_index *index;
 	if ( tree->id == id )
 		res = tree;
-	else {
+	else if ( prg->index_count > 0 &&
+			( index = colm_tree_index_find( prg, tree, id ) ) != 0 )
+	{
+		/* Recorded by an iteration. */
+		if ( index->matches_len > 0 )
+			res = index->els[index->matches[0]].kid->tree;
+	}
+	else if ( lel_can_contain( prg->rtd->lel_info, tree->id, id ) ) {
 		kid_t *child = tree_child( prg, tree );
 		if ( child != 0 )
 			res = tree_search_kid( prg, child, id );
@@ -1563,21 +1903,35 @@ tree_t *tree_search( program_t *prg, tree_t *tree, long id )
 
 static location_t *loc_search_kid( program_t *prg, kid_t *kid )
 {
-	/* This node the one? */
-	if ( kid->tree->tokdata != 0 && kid->tree->tokdata->location != 0 )
-		return kid->tree->tokdata->location;
-
+	struct tree_walk walk;
 	location_t *res = 0;
 
-	/* Search children. */
-	kid_t *child = tree_child( prg, kid->tree );
-	if ( child != 0 )
-		res = loc_search_kid( prg, child );
-	
-	/* Search siblings. */
-	if ( res == 0 && kid->next != 0 )
-		res = loc_search_kid( prg, kid->next );
+	tree_walk_init( &walk );
+
+	while ( true ) {
+		/* This node the one? */
+		if ( kid->tree->tokdata != 0 && kid->tree->tokdata->location != 0 ) {
+			res = kid->tree->tokdata->location;
+			break;
+		}
+
+		kid_t *child = tree_child( prg, kid->tree );
+
+		if ( child != 0 ) {
+			/* Siblings after the children. */
+			if ( kid->next != 0 )
+				tree_walk_push( &walk, kid->next, 0, 0, 0 );
+			kid = child;
+		}
+		else if ( kid->next != 0 )
+			kid = kid->next;
+		else if ( walk.len > 0 )
+			kid = walk.data[--walk.len].kid1;
+		else
+			break;
+	}
 
+	tree_walk_clear( &walk );
 	return res;	
 }
 
@@ -57,14 +57,19 @@ typedef struct colm_location
 	long line;
 	long column;
 	long byte;
+
+	/* Offset from the start of the input, running across its streams. */
+	long input_byte;
 } location_t;
 
-/* Header located just before string data. */
+/* Header located just before string data. Token data and its location do
+ * not change once created, so copies of a tree share the head. */
 typedef struct colm_data
 {
 	const char *data; 
 	long length;
 	struct colm_location *location;
+	long refs;
 } head_t;
 
 typedef struct colm_kid
@@ -89,25 +94,37 @@ struct tree_pair
 	tree_t *val;
 };
 
+/* Parse tree data that most nodes never need: attached ignores and the token
+ * region to retry from. Allocated on first use. */
+typedef struct colm_parse_ext
+{
+	struct colm_parse_tree *left_ignore;
+	struct colm_parse_tree *right_ignore;
+	long retry_region;
+} parse_ext_t;
+
 typedef struct colm_parse_tree
 {
 	short id;
 	unsigned short flags;
 
-	struct colm_parse_tree *child;
-	struct colm_parse_tree *next;
-	struct colm_parse_tree *left_ignore;
-	struct colm_parse_tree *right_ignore;
-	kid_t *shadow;
-
 	/* Parsing algorithm. */
-	long state;
 	short cause_reduce;
 
 	/* Retry vars. Might be able to unify lower and upper. */
-	long retry_region;
 	char retry_lower;
 	char retry_upper;
+	int state;
+
+	/* Interned parse stack from here down, set by a backtracking memo lookup
+	 * and cleared when pushed. Zero if not interned. */
+	unsigned int stack;
+
+	struct colm_parse_tree *child;
+	struct colm_parse_tree *next;
+	kid_t *shadow;
+
+	parse_ext_t *ext;
 } parse_tree_t;
 
 typedef struct colm_pointer
@@ -115,6 +132,7 @@ typedef struct colm_pointer
 	/* Must overlay tree_t. */
 	short id;
 	unsigned short flags;
+	unsigned int hash;
 	long refs;
 	kid_t *child;
 
@@ -126,6 +144,7 @@ typedef struct colm_str
 	/* Must overlay tree_t. */
 	short id;
 	unsigned short flags;
+	unsigned int hash;
 	long refs;
 	kid_t *child;
 
@@ -135,6 +154,17 @@ typedef struct colm_str
 /*
  * Maps
  */
+
+/* Key comparison of a map, chosen by the compiler from the key type. */
+enum KEY_CMP
+{
+	KEY_CMP_TREE = 0,
+	KEY_CMP_INT,
+	KEY_CMP_PTR,
+	KEY_CMP_STR,
+	KEY_CMP_TOKEN
+};
+
 struct generic_info
 {
 	long type;
@@ -144,6 +174,7 @@ struct generic_info
 
 	enum TYPE key_type;
 	long key_offset;
+	enum KEY_CMP key_cmp;
 
 	enum TYPE value_type;
 	long value_offset;
@@ -158,6 +189,52 @@ enum IterType
 	IT_User
 };
 
+/* Positions of one type in a tree, recorded by a complete iteration over it
+ * and replayed by later ones. The index holds a reference to the root, so
+ * any change to the tree goes through a copy, which drops the index. */
+struct tree_index_el
+{
+	kid_t *kid;
+	long parent;
+	long depth;
+};
+
+struct tree_index
+{
+	tree_t *root;
+	long search_id;
+	unsigned char complete;
+	unsigned char dead;
+	long users;
+
+	struct tree_index_el *els;
+	long els_len;
+	long els_alloc;
+
+	long *matches;
+	long matches_len;
+	long matches_alloc;
+
+	/* Element at each level of the last recorded position. Scratch space
+	 * when replaying. */
+	long *path;
+	long path_len;
+	long path_alloc;
+	kid_t **kids;
+
+	struct tree_index *prev, *next;
+};
+
+/* Trees whose first walk looked worth indexing. The next walk over one of
+ * them records an index. */
+#define TREE_INDEX_SEEN 16
+
+struct tree_index_seen
+{
+	tree_t *root;
+	long search_id;
+};
+
 typedef struct colm_tree_iter
 {
 	enum IterType type;
@@ -168,6 +245,12 @@ typedef struct colm_tree_iter
 	long arg_size;
 	long yield_size;
 	long root_size;
+
+	struct tree_index *index;
+	long index_pos;
+	long visits;
+	long matched;
+	long low;
 } tree_iter_t;
 
 typedef struct colm_generic_iter
@@ -218,6 +301,9 @@ void colm_tree_upref_( tree_t *tree );
 void colm_tree_upref( struct colm_program *prg, tree_t *tree );
 void colm_tree_downref( struct colm_program *prg, tree_t **sp, tree_t *tree );
 long colm_cmp_tree( struct colm_program *prg, const tree_t *tree1, const tree_t *tree2 );
+unsigned int colm_tree_hash( struct colm_program *prg, tree_t *tree );
+int colm_tree_eql( struct colm_program *prg, tree_t *tree1, tree_t *tree2 );
+void colm_share_tokens( struct colm_program *prg, tree_t **sp, tree_t *tree );
 
 tree_t *push_right_ignore( struct colm_program *prg, tree_t *push_to, tree_t *right_ignore );
 tree_t *push_left_ignore( struct colm_program *prg, tree_t *push_to, tree_t *left_ignore );
@@ -268,8 +354,6 @@ void set_uiter_cur( struct colm_program *prg, user_iter_t *uiter, tree_t *tree )
 void ref_set_value( struct colm_program *prg, tree_t **sp, ref_t *ref, tree_t *v );
 tree_t *tree_search( struct colm_program *prg, tree_t *tree, long id );
 
-int match_pattern( tree_t **bindings, struct colm_program *prg,
-		long pat, kid_t *kid, int check_next );
 tree_t *tree_iter_deref_cur( tree_iter_t *iter );
 
 /* For making references of attributes. */
@@ -288,6 +372,10 @@ tree_t *get_list_mem_split( struct colm_program *prg, list_t *list, word_t field
 tree_t *get_parser_mem( parser_t *parser, word_t field );
 
 tree_t *tree_iter_advance( struct colm_program *prg, tree_t ***psp, tree_iter_t *iter );
+struct tree_index *colm_tree_index_find( struct colm_program *prg, tree_t *root, long search_id );
+void colm_tree_index_split( struct colm_program *prg, tree_t **sp, tree_t *tree );
+void colm_tree_index_unused( struct colm_program *prg, tree_t **sp, tree_t *tree );
+void colm_tree_index_clear( struct colm_program *prg, tree_t **sp );
 tree_t *tree_iter_next_child( struct colm_program *prg, tree_t ***psp, tree_iter_t *iter );
 tree_t *tree_rev_iter_prev_child( struct colm_program *prg, tree_t ***psp, rev_tree_iter_t *iter );
 tree_t *tree_iter_next_repeat( struct colm_program *prg, tree_t ***psp, tree_iter_t *iter );
@@ -370,6 +458,11 @@ void colm_vlist_prepend( struct colm_program *prg, list_t *list, value_t value )
 value_t colm_vlist_detach_head( struct colm_program *prg, list_t *list );
 value_t colm_vlist_detach_tail( struct colm_program *prg, list_t *list );
 
+void colm_vector_push( struct colm_program *prg, vector_t *vector, value_t value );
+value_t colm_vector_pop( struct colm_program *prg, vector_t *vector );
+value_t colm_vector_get( struct colm_program *prg, vector_t *vector, long pos );
+void colm_vector_sort( struct colm_program *prg, vector_t *vector );
+
 value_t colm_viter_deref_cur( struct colm_program *prg, generic_iter_t *iter );
 
 str_t *string_prefix( program_t *prg, str_t *str, long len );
@@ -0,0 +1,174 @@
+#!/bin/bash
+#
+# Copyright 2018 Adrian Thurston <thurston@colm.net>
+#
+
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+#
+# Runs the cases in colm.d. A case is a colm program followed by sections:
+#
+#   ##### LM #####     the program
+#   ##### IN #####     standard input, optional
+#   ##### ARGS #####   arguments to the program, optional
+#   ##### OPTS #####   sets of compiler options, one per line, optional
+#   ##### HOST #####   a C host for the program, optional
+#   ##### NEEDS #####  config.h macros the case needs, optional
+#   ##### EXP #####    the expected output
+#
+# The program is built without options, then once for each line of OPTS, and
+# every build must print the expected output. The expected output is what
+# the default build prints, so each option is checked against it. Each build
+# is run with standard input from a pipe and again from a file. The input is
+# also left in the working directory as NAME.in, and gzipped as NAME.in.gz,
+# for programs that open it by name.
+#
+# A case with a HOST section is compiled with -c and linked with the host,
+# which provides main. A case is skipped if the build did not define one of
+# the macros listed under NEEDS.
+#
+# Usage: runtests [case.lm ...]
+#
+
+COLM="@COLM@"
+CASES="@CASES@"
+BUILDDIR="@BUILDDIR@"
+SRCDIR="@SRCDIR@"
+CC="@CC@"
+
+WORKING=working
+
+section()
+{
+	awk -v want="$1" '
+		/^##### [A-Z]+ #####$/ { on = ( $2 == want ); next; }
+		on { print; }
+	' "$2"
+}
+
+has_section()
+{
+	grep -q "^##### $1 #####\$" "$2"
+}
+
+# Build the case into WORKING/NAME with the options given.
+build()
+{
+	local name=$1 opts=$2
+
+	if [ -f $name-host.c ]; then
+		$COLM $opts -c -o $name.c $name.lm &&
+			$CC -o $name -I$SRCDIR/aapl -I$BUILDDIR/src/include \
+				$name-host.c $name.c -L$BUILDDIR/src/.libs -lcolm \
+				-Wl,-rpath,$BUILDDIR/src/.libs
+	else
+		$COLM $opts -o $name $name.lm
+	fi
+}
+
+# Run the build with stdin given by the second arg and compare.
+check()
+{
+	local name=$1 how=$2 opts=$3
+
+	if [ $how = pipe ]; then
+		cat $name.in | ./$name $ARGS > $name.out 2>&1
+	else
+		./$name $ARGS < $name.in > $name.out 2>&1
+	fi
+
+	if diff -u $name.exp $name.out > $name.diff; then
+		return 0
+	fi
+
+	echo "FAIL: $name [$opts] stdin from $how"
+	cat $name.diff
+	return 1
+}
+
+run_case()
+{
+	local lm=$1
+	local name=`basename $lm .lm`
+	local status=0
+
+	for need in `section NEEDS $lm`; do
+		if ! grep -q "^#define $need 1\$" $BUILDDIR/src/config.h; then
+			echo "SKIP: $name, $need is not defined"
+			return 0
+		fi
+	done
+
+	section LM $lm > $WORKING/$name.lm
+	section IN $lm > $WORKING/$name.in
+	section EXP $lm > $WORKING/$name.exp
+	rm -f $WORKING/$name-host.c
+	if has_section HOST $lm; then
+		section HOST $lm > $WORKING/$name-host.c
+	fi
+
+	ARGS=`section ARGS $lm`
+
+	cd $WORKING
+	gzip -nc $name.in > $name.in.gz 2>/dev/null
+
+	# The default build first, then one for each set of options.
+	( echo; section OPTS $lm ) | while read opts; do
+		if ! build $name "$opts" > $name.build 2>&1; then
+			echo "FAIL: $name [$opts] did not build"
+			cat $name.build
+			exit 1
+		fi
+		check $name pipe "$opts" || exit 1
+		check $name file "$opts" || exit 1
+	done
+	status=$?
+
+	cd ..
+	if [ $status = 0 ]; then
+		echo "PASS: $name"
+	fi
+	return $status
+}
+
+if [ $# = 0 ]; then
+	set -- $CASES/*.lm
+fi
+
+given=""
+for lm in "$@"; do
+	case $lm in
+		/*) given="$given $lm" ;;
+		*) given="$given `pwd`/$lm" ;;
+	esac
+done
+
+cd `dirname $0`
+mkdir -p $WORKING
+
+failed=0
+for lm in $given; do
+	run_case $lm || failed=$((failed + 1))
+done
+
+if [ $failed != 0 ]; then
+	echo "$failed case(s) failed"
+	exit 1
+fi
+exit 0